@@ -298,7 +298,9 @@ const static char messages[] PROGMEM =
 #define MSG_SET_SPEED_TO_HZ 52
     "Set speed (steps/s) to |"
 #define MSG_PASS_STATUS 53
-    "Test passed\n|";
+    "Test passed\n|"
+#define MSG_START_QUEUES 54
+    "Start all steppers together with steps |";
 
 void output_msg(int8_t i) {
   char ch;
@@ -602,6 +604,7 @@ const static char usage_str[] PROGMEM =
     "     p<n>,l,h  ... Attach pulse counter n<=7 with low and high limits\n"
     "     pc        ... Clear pulse counter\n"
 #endif
+    "     Y<n>      ... Start all steppers together with n steps at 1ms/step\n"
     "     t         ... Enter test mode\n"
     "     u         ... Unidirectional mode (need reset to restore)\n"
 #if defined(ARDUINO_ARCH_AVR)
@@ -680,6 +683,37 @@ void usage() {
   stepper_info();
 }
 
+// Prepare the queues of all steppers with n steps at 1ms/step and start them
+// together. The first steps of all steppers should coincide.
+void start_queues(uint32_t n) {
+  uint8_t stepper_mask = 0;
+  for (uint8_t i = 0; i < MAX_STEPPER; i++) {
+    FastAccelStepper *s = stepper[i];
+    if ((s == NULL) || s->isRunning()) {
+      continue;
+    }
+    uint32_t steps = n;
+    while (steps > 0) {
+      struct stepper_command_s cmd = {
+          .ticks = TICKS_PER_S / 1000, .steps = 0, .count_up = true};
+      cmd.steps = min(steps, (uint32_t)255);
+      int8_t res = s->addQueueEntry(&cmd, false);
+      if (res != AQE_OK) {
+        output_msg(MSG_RETURN_CODE);
+        Serial.println(res);
+        break;
+      }
+      steps -= cmd.steps;
+    }
+    stepper_mask |= 1 << i;
+  }
+  int8_t res = engine.startQueues(stepper_mask);
+  if (res != AQE_OK) {
+    output_msg(MSG_RETURN_CODE);
+    Serial.println(res);
+  }
+}
+
 void output_info(bool only_running) {
   bool need_ln = false;
   for (uint8_t i = 0; i < MAX_STEPPER; i++) {
@@ -802,6 +836,10 @@ void loop() {
         output_msg(MSG_ENTER_TEST_MODE);
         test_mode = true;
         usage();
+      } else if (!test_mode && (sscanf(out_buffer, "Y%lu", &val) == 1)) {
+        output_msg(MSG_START_QUEUES);
+        Serial.println(val);
+        start_queues(val);
       } else if (selected >= 0) {
         FastAccelStepper *stepper_selected = stepper[selected];
         if (!test_mode) {
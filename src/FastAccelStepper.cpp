@@ -133,6 +133,30 @@ FastAccelStepper* FastAccelStepperEngine::stepperConnectToPin(
 #endif
 }
 //*************************************************************************************************
+int8_t StepperQueue::_selectQueuesToStart(uint8_t* queue_mask) {
+  for (uint8_t i = 0; i < NUM_QUEUES; i++) {
+    if (*queue_mask & (1 << i)) {
+      if (fas_queue[i].isQueueEmpty()) {
+        return AQE_ERROR_EMPTY_QUEUE_TO_START;
+      }
+      if (fas_queue[i]._isStarted()) {
+        *queue_mask &= ~(1 << i);
+      }
+    }
+  }
+  return AQE_OK;
+}
+int8_t FastAccelStepperEngine::startQueues(uint8_t stepper_mask) {
+  uint8_t queue_mask = 0;
+  for (uint8_t i = 0; i < MAX_STEPPER; i++) {
+    FastAccelStepper* s = _stepper[i];
+    if (s && (stepper_mask & (1 << i))) {
+      queue_mask |= 1 << s->_queue_num;
+    }
+  }
+  return StepperQueue::startPreparedQueues(queue_mask);
+}
+//*************************************************************************************************
 void FastAccelStepperEngine::setDebugLed(uint8_t ledPin) {
   fas_ledPin = ledPin;
   pinMode(fas_ledPin, OUTPUT);
@@ -213,6 +237,106 @@ void FastAccelStepperEngine::manageSteppers() {
   }
 }
 
+//*************************************************************************************************
+int8_t FastAccelStepperEngine::moveToCoordinated(FastAccelStepper* steppers[],
+                                                 const int32_t positions[],
+                                                 uint8_t count) {
+  if ((count == 0) || (count > MAX_STEPPER)) {
+    return MOVE_ERR_COORDINATED_INVALID;
+  }
+  uint32_t steps[MAX_STEPPER];
+  uint8_t master = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    FastAccelStepper* s = steppers[i];
+    if (s == NULL) {
+      return MOVE_ERR_COORDINATED_INVALID;
+    }
+    for (uint8_t j = 0; j < i; j++) {
+      if (steppers[j] == s) {
+        return MOVE_ERR_COORDINATED_INVALID;
+      }
+    }
+    if (s->isRunning() || s->isRampGeneratorActive() ||
+        (s->_coord_slaves != 0) || (s->_rg.getJerk() != 0)) {
+      return MOVE_ERR_COORDINATED_INVALID;
+    }
+    if (s->_rg.getSpeedInTicks() == 0) {
+      return MOVE_ERR_SPEED_IS_UNDEFINED;
+    }
+    if (s->_rg.getAcceleration() == 0) {
+      return MOVE_ERR_ACCELERATION_IS_UNDEFINED;
+    }
+    int32_t delta = positions[i] - s->getPositionAfterCommandsCompleted();
+    if ((delta < 0) && (s->_dirPin == PIN_UNDEFINED)) {
+      return MOVE_ERR_NO_DIRECTION_PIN;
+    }
+    steps[i] = (delta < 0) ? -delta : delta;
+    // bresenham calculation in _coordinatedFollow() needs steps < 2^24
+    if (steps[i] > 0xffffff) {
+      return MOVE_ERR_COORDINATED_INVALID;
+    }
+    if (steps[i] > steps[master]) {
+      master = i;
+    }
+  }
+  uint32_t master_steps = steps[master];
+  if (master_steps == 0) {
+    return MOVE_OK;
+  }
+
+  // The master's speed/acceleration/deceleration are limited, so that no
+  // stepper exceeds its own limits: a stepper with n steps runs with n/N of
+  // the master's speed and acceleration.
+  uint32_t ticks = 0;
+  uint32_t accel = 0x7fffffff;
+  uint32_t decel = 0x7fffffff;
+  FastAccelStepper* m = steppers[master];
+  // _coord_master_steps != 0 keeps fill_queue() from finishing the
+  // coordination, while it is set up
+  m->_coord_master_steps = master_steps;
+  m->_coord_slaves = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    FastAccelStepper* s = steppers[i];
+    if (steps[i] == 0) {
+      continue;
+    }
+    uint32_t t = s->_rg.getSpeedInTicks();
+    uint32_t a = s->_rg.getAcceleration();
+    uint32_t d = s->_rg.getDeceleration();
+    if (steps[i] != master_steps) {
+      upm_float scale = upm_divide(upm_from(master_steps), upm_from(steps[i]));
+      // pseudo float has ~0.4% error, so add 1/128 as margin
+      t = upm_to_u32(upm_divide(upm_from(t), scale));
+      t += t >> 7;
+      a = min(upm_to_u32(upm_multiply(upm_from(a), scale)), 0x7fffffff);
+      a -= a >> 7;
+      d = min(upm_to_u32(upm_multiply(upm_from(d), scale)), 0x7fffffff);
+      d -= d >> 7;
+    }
+    ticks = max(ticks, t);
+    accel = min(accel, a);
+    decel = min(decel, d);
+    if (s != m) {
+      struct FastAccelStepper::coordinated_slave_s* c =
+          &m->_coord[m->_coord_slaves++];
+      c->stepper = s;
+      c->steps = steps[i];
+      // the last step of the slave coincides with the last master step
+      c->err = 0;
+      c->pending_ticks = 0;
+      c->pending_steps = 0;
+      c->count_up = positions[i] > s->getPositionAfterCommandsCompleted();
+    }
+  }
+  int8_t res = m->_rg.moveToWithLimits(
+      positions[master], &fas_queue[m->_queue_num].queue_end, ticks, accel,
+      decel);
+  if (res != MOVE_OK) {
+    m->_coord_slaves = 0;
+  }
+  return res;
+}
+
 //*************************************************************************************************
 //*************************************************************************************************
 //
@@ -228,6 +352,35 @@ void FastAccelStepperEngine::manageSteppers() {
 //*************************************************************************************************
 int8_t FastAccelStepper::addQueueEntry(const struct stepper_command_s* cmd,
                                        bool start) {
+  return _addQueueEntry(cmd, start, 0, 0);
+}
+int8_t FastAccelStepper::addRepeatedPause(uint16_t ticks, uint8_t repeat,
+                                          bool start) {
+  struct stepper_command_s cmd = {
+      .ticks = ticks,
+      .steps = 0,
+      .count_up = fas_queue[_queue_num].queue_end.count_up};
+  return _addQueueEntry(&cmd, start, repeat, 0);
+}
+int8_t FastAccelStepper::addMarker(uint8_t tag, uint16_t ticks, bool start) {
+  if (tag == 0) {
+    return AQE_ERROR_INVALID_TAG;
+  }
+  struct stepper_command_s cmd = {
+      .ticks = ticks,
+      .steps = 0,
+      .count_up = fas_queue[_queue_num].queue_end.count_up};
+  return _addQueueEntry(&cmd, start, 0, tag);
+}
+uint8_t FastAccelStepper::getMarkerEvent() {
+  return fas_queue[_queue_num].getMarkerEvent();
+}
+uint8_t FastAccelStepper::getLostMarkerEvents() {
+  return fas_queue[_queue_num]._lost_markers;
+}
+int8_t FastAccelStepper::_addQueueEntry(const struct stepper_command_s* cmd,
+                                        bool start, uint8_t repeat,
+                                        uint8_t tag) {
   StepperQueue* q = &fas_queue[_queue_num];
   if (cmd == NULL) {
     return q->addQueueEntry(NULL, start);
@@ -264,17 +417,18 @@ int8_t FastAccelStepper::addQueueEntry(const struct stepper_command_s* cmd,
       if (_on_delay_ticks > 0) {
         uint32_t delay = _on_delay_ticks;
         while (delay > 0) {
-          uint32_t ticks = delay >> 1;
-          uint16_t ticks_u16 = ticks;
-          if (ticks > 65535) {
-            ticks_u16 = 65535;
-          } else if (ticks < 32768) {
-            ticks_u16 = delay;
+          // One repeated pause of equal periods. If the repeat count is
+          // insufficient, the remaining delay stays above 65535 ticks
+          uint32_t pauses = (delay + 65534) / 65535;
+          if (pauses > MAX_PAUSE_REPEAT + 1) {
+            pauses = MAX_PAUSE_REPEAT + 1;
           }
+          uint32_t ticks = (delay + pauses - 1) / pauses;
+          uint16_t ticks_u16 = min(ticks, 65535);
           struct stepper_command_s start_cmd = {
               .ticks = ticks_u16, .steps = 0, .count_up = cmd->count_up};
-          res = q->addQueueEntry(&start_cmd, start);
-          delay -= ticks_u16;
+          res = q->addQueueEntry(&start_cmd, start, pauses - 1);
+          delay -= min(delay, (uint32_t)ticks_u16 * pauses);
         }
         if (res != AQE_OK) {
           return res;
@@ -282,7 +436,7 @@ int8_t FastAccelStepper::addQueueEntry(const struct stepper_command_s* cmd,
       }
     }
   }
-  res = q->addQueueEntry(cmd, start);
+  res = q->addQueueEntry(cmd, start, repeat, tag);
   if (_autoEnable) {
     if (res == AQE_OK) {
       noInterrupts();
@@ -293,11 +447,29 @@ int8_t FastAccelStepper::addQueueEntry(const struct stepper_command_s* cmd,
 
   return res;
 }
+uint16_t FastAccelStepper::addQueueEntries(const struct stepper_command_s* cmds,
+                                           uint16_t n, bool start) {
+  if (n == 0) {
+    return 0;
+  }
+  // The first command takes care of direction pin and auto enable
+  if (addQueueEntry(cmds, start) != AQE_OK) {
+    return 0;
+  }
+  // Same checks as in addQueueEntry() for the remaining commands
+  uint16_t valid = 1;
+  while ((valid < n) && (cmds[valid].ticks >= MIN_DELTA_TICKS) &&
+         (cmds[valid].count_up || (_dirPin != PIN_UNDEFINED))) {
+    valid++;
+  }
+  StepperQueue* q = &fas_queue[_queue_num];
+  return 1 + q->addQueueEntries(&cmds[1], valid - 1, start);
+}
 
 //*************************************************************************************************
 // fill_queue generates commands to the stepper for executing a ramp
 //
-// Plan is to fill the queue with commmands with approx. 10 ms ahead (or
+// Plan is to fill the queue with commmands for the lookahead time (or
 // more). For low speeds, this results in single stepping For high speeds
 // (40kSteps/s) approx. 400 Steps to be created using 3 commands
 //
@@ -315,9 +487,27 @@ int8_t FastAccelStepper::addQueueEntry(const struct stepper_command_s* cmd,
 //
 //*************************************************************************************************
 
+// The lookahead is adapted based on the queue depth found at begin of
+// fill_queue(). A nearly drained queue means, the fill calls are late compared
+// to the lookahead, so increase it fast. A mostly full queue allows to
+// slowly reduce the latency again.
+void FastAccelStepper::_adaptLookAhead(uint32_t ticks_in_queue) {
+  if (ticks_in_queue < _lookahead_ticks / 4) {
+    _lookahead_ticks += _lookahead_ticks / 2;
+    _lookahead_ticks = min(_lookahead_ticks, _max_lookahead_ticks);
+  } else if (ticks_in_queue > _lookahead_ticks - _lookahead_ticks / 4) {
+    _lookahead_ticks -= _lookahead_ticks / 32;
+    _lookahead_ticks = max(_lookahead_ticks, _min_lookahead_ticks);
+  }
+}
+
 void FastAccelStepper::fill_queue() {
+  if ((_coord_slaves != 0) && (_coord_master_steps == 0)) {
+    _coordinatedFinish();
+  }
   // Check preconditions to be allowed to fill the queue
   if (!_rg.isRampGeneratorActive()) {
+    _fill_ramp_active = false;
     return;
   }
   if (!_rg.hasValidConfig()) {
@@ -327,15 +517,28 @@ void FastAccelStepper::fill_queue() {
     return;
   }
   // preconditions are fulfilled, so create the command(s)
+#if (FAS_LATENCY_STATS == 1)
+  uint32_t fill_start_us = micros();
+#else
+  uint32_t fill_start_us = 0;
+#endif
+  uint8_t commands = 0;
   NextCommand cmd;
   StepperQueue* q = &fas_queue[_queue_num];
-  // Plan ahead for max. 20 ms. Currently hard coded
   bool delayed_start = !q->isRunning();
   bool need_delayed_start = false;
   uint32_t ticksPrepared = q->ticksInQueue();
+  // Measure only, if the queue has been filled for the running ramp before.
+  // Then an empty queue is an underrun.
+  if (_fill_ramp_active) {
+    q->_updateStats(ticksPrepared, q->isQueueEmpty());
+    if (_min_lookahead_ticks != _max_lookahead_ticks) {
+      _adaptLookAhead(ticksPrepared);
+    }
+  }
   while (!isQueueFull() &&
-         ((ticksPrepared < TICKS_PER_S / 50) || q->queueEntries() <= 1) &&
-         _rg.isRampGeneratorActive()) {
+         ((ticksPrepared < _lookahead_ticks) || q->queueEntries() <= 1) &&
+         _rg.isRampGeneratorActive() && _coordinatedSlavesReady()) {
 #if (TEST_MEASURE_ISR_SINGLE_FILL == 1)
     // For run time measurement
     uint32_t runtime_us = micros();
@@ -346,7 +549,13 @@ void FastAccelStepper::fill_queue() {
       res = addQueueEntry(&cmd.command, !delayed_start);
     }
     if (res == AQE_OK) {
+      if (cmd.command.ticks != 0) {
+        commands++;
+      }
       _rg.afterCommandEnqueued(&cmd);
+      if ((_coord_slaves != 0) && (cmd.command.ticks != 0)) {
+        _coordinatedFollow(&cmd.command);
+      }
       need_delayed_start = delayed_start;
       if (cmd.command.steps <= 1) {
         ticksPrepared += cmd.command.ticks;
@@ -363,6 +572,8 @@ void FastAccelStepper::fill_queue() {
     max_micros = max(max_micros, runtime_us);
 #endif
     if (cmd.command.ticks == 0) {
+      // ramp is finished
+      _coord_master_steps = 0;
       break;
     }
     if (res != AQE_OK) {
@@ -386,13 +597,167 @@ void FastAccelStepper::fill_queue() {
         assert(false);
 #endif
         _rg.stopRamp();
+        _coord_master_steps = 0;
         delayed_start = false;
       }
     }
   }
+  if (_coord_slaves != 0) {
+    if (_coord_master_steps == 0) {
+      _coordinatedFinish();
+    }
+    // master and slaves start on the same tick
+    _coordinatedStart(need_delayed_start);
+    need_delayed_start = false;
+  }
   if (need_delayed_start) {
     addQueueEntry(NULL, true);
   }
+  // e.g. waiting for enable pin or direction pin leaves the queue empty
+  _fill_ramp_active = _rg.isRampGeneratorActive() && !q->isQueueEmpty();
+  q->_recordFill(fill_start_us, commands);
+}
+
+//*************************************************************************************************
+// Coordinated move
+//
+// The master runs the ramp and after each enqueued command, the steps of the
+// slaves are derived by bresenham: a slave with n steps performs n/N steps
+// per master step, with N being the steps of the master. The duration of the
+// master command is added to pending_ticks of each slave. Pending steps are
+// then evenly distributed over pending_ticks. Fractions are kept for the next
+// command, so the slave's queue time follows the master's queue time.
+//
+//*************************************************************************************************
+bool FastAccelStepper::_coordinatedSlavesReady() {
+  for (uint8_t i = 0; i < _coord_slaves; i++) {
+    struct coordinated_slave_s* c = &_coord[i];
+    if (!_coordinatedFlush(c, false)) {
+      return false;
+    }
+    // one master command needs up to three slave commands
+    if (fas_queue[c->stepper->_queue_num].queueEntries() > QUEUE_LEN - 3) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void FastAccelStepper::_coordinatedFollow(const struct stepper_command_s* cmd) {
+  uint32_t ticks = cmd->ticks;
+  if (cmd->steps > 1) {
+    ticks *= cmd->steps;
+  }
+  for (uint8_t i = 0; i < _coord_slaves; i++) {
+    struct coordinated_slave_s* c = &_coord[i];
+#if (FAS_EXTENDED_STEPS == 1)
+    // 16 bit command steps times slave steps below 2^24 need 64 bit
+    uint64_t acc = c->err + (uint64_t)cmd->steps * c->steps;
+#else
+    // 8 bit command steps times slave steps below 2^24 fit into 32 bit
+    uint32_t acc = c->err + cmd->steps * c->steps;
+#endif
+    uint32_t steps = acc / _coord_master_steps;
+    // the remainder is below 2^24, so the lower 32 bits are sufficient
+    c->err = (uint32_t)acc - steps * _coord_master_steps;
+    c->pending_steps += steps;
+    c->pending_ticks += ticks;
+    _coordinatedFlush(c, false);
+  }
+}
+
+// Returns false, if the slave's queue cannot take all commands.
+// If final is set, then all pending steps are enqueued.
+bool FastAccelStepper::_coordinatedFlush(struct coordinated_slave_s* c,
+                                         bool final) {
+  FastAccelStepper* slave = c->stepper;
+  StepperQueue* q = &fas_queue[slave->_queue_num];
+  while (true) {
+    struct stepper_command_s cmd;
+    cmd.count_up = c->count_up;
+    uint32_t steps = c->pending_steps;
+    uint32_t ticks = c->pending_ticks;
+    // Time beyond the longest possible step period is enqueued as pause
+    // in front of the steps
+    uint32_t pause_ticks = ticks - min(ticks, steps * 65535);
+    if ((steps != 0) && (pause_ticks < MIN_CMD_TICKS)) {
+      ticks /= steps;
+      steps = min(steps, MAX_CMD_STEPS);
+      if (ticks * steps < MIN_CMD_TICKS) {
+        if (!final) {
+          // wait for the next master command
+          return true;
+        }
+        ticks = (MIN_CMD_TICKS + steps - 1) / steps;
+      }
+      cmd.steps = steps;
+      cmd.ticks = min(ticks, 65535);
+    } else {
+      if (pause_ticks < MIN_CMD_TICKS) {
+        // no steps left. A remaining short pause is not needed at the end
+        if (final) {
+          c->pending_ticks = 0;
+        }
+        return true;
+      }
+      if (pause_ticks > 65535) {
+        // keep at least MIN_CMD_TICKS for the next pause
+        pause_ticks = min(pause_ticks - MIN_CMD_TICKS, 65535);
+      }
+      steps = 0;
+      ticks = pause_ticks;
+      cmd.steps = 0;
+      cmd.ticks = ticks;
+    }
+    int8_t res = slave->addQueueEntry(&cmd, q->isRunning());
+    if (res != AQE_OK) {
+      if (res > 0) {
+        // try later again
+        return false;
+      }
+#ifdef TEST
+      printf("ERROR: Coordinated slave queue error (%d)\n", res);
+      assert(false);
+#endif
+      // drop this slave's pending steps
+      c->pending_steps = 0;
+      c->pending_ticks = 0;
+      return true;
+    }
+    uint32_t used_ticks = cmd.ticks;
+    if (steps > 1) {
+      used_ticks *= steps;
+    }
+    c->pending_steps -= steps;
+    c->pending_ticks -= min(used_ticks, c->pending_ticks);
+  }
+}
+
+void FastAccelStepper::_coordinatedStart(bool start_master) {
+  uint8_t queue_mask = 0;
+  if (start_master) {
+    queue_mask |= 1 << _queue_num;
+  }
+  for (uint8_t i = 0; i < _coord_slaves; i++) {
+    FastAccelStepper* slave = _coord[i].stepper;
+    StepperQueue* q = &fas_queue[slave->_queue_num];
+    if (!q->_isStarted() && !q->isQueueEmpty()) {
+      queue_mask |= 1 << slave->_queue_num;
+    }
+  }
+  if (queue_mask != 0) {
+    StepperQueue::startPreparedQueues(queue_mask);
+  }
+}
+
+void FastAccelStepper::_coordinatedFinish() {
+  for (uint8_t i = 0; i < _coord_slaves; i++) {
+    if (!_coordinatedFlush(&_coord[i], true)) {
+      return;
+    }
+  }
+  _coordinatedStart(false);
+  _coord_slaves = 0;
 }
 
 void FastAccelStepper::updateAutoDisable() {
@@ -457,6 +822,12 @@ void FastAccelStepper::init(FastAccelStepperEngine* engine, uint8_t num,
   _dirHighCountsUp = true;
   _rg.init();
   _externalEnableCall = NULL;
+  _coord_slaves = 0;
+  // Plan ahead for 20 ms
+  _lookahead_ticks = TICKS_PER_S / 50;
+  _min_lookahead_ticks = _lookahead_ticks;
+  _max_lookahead_ticks = _lookahead_ticks;
+  _fill_ramp_active = false;
 
   _queue_num = num;
   fas_queue[_queue_num].init(_queue_num, step_pin);
@@ -464,6 +835,49 @@ void FastAccelStepper::init(FastAccelStepperEngine* engine, uint8_t num,
   _attached_pulse_cnt_unit = -1;
 #endif
 }
+int8_t FastAccelStepper::setLookAheadInMs(uint16_t min_ms, uint16_t max_ms) {
+  if ((min_ms == 0) || (min_ms > max_ms)) {
+    return -1;
+  }
+  _min_lookahead_ticks = (uint32_t)min_ms * (TICKS_PER_S / 1000);
+  _max_lookahead_ticks = (uint32_t)max_ms * (TICKS_PER_S / 1000);
+  _lookahead_ticks = max(_lookahead_ticks, _min_lookahead_ticks);
+  _lookahead_ticks = min(_lookahead_ticks, _max_lookahead_ticks);
+  return 0;
+}
+void FastAccelStepper::getQueueStats(struct queue_stats_s* stats) {
+  StepperQueue* q = &fas_queue[_queue_num];
+  noInterrupts();
+  *stats = q->stats;
+  interrupts();
+}
+void FastAccelStepper::resetQueueStats() {
+  StepperQueue* q = &fas_queue[_queue_num];
+  noInterrupts();
+  q->_resetStats();
+  interrupts();
+}
+#if (FAS_LATENCY_STATS == 1)
+void FastAccelStepper::getLatencyStats(struct latency_stats_s* stats) {
+  StepperQueue* q = &fas_queue[_queue_num];
+  noInterrupts();
+  *stats = q->latency;
+  interrupts();
+}
+void FastAccelStepper::resetLatencyStats() {
+  StepperQueue* q = &fas_queue[_queue_num];
+  noInterrupts();
+  q->_resetLatencyStats();
+  interrupts();
+}
+#endif
+int8_t FastAccelStepper::setCommandDurationInUs(uint32_t duration_us) {
+  if ((duration_us < MIN_CMD_DURATION_US) ||
+      (duration_us > MAX_CMD_DURATION_US)) {
+    return -1;
+  }
+  return _rg.setCommandDurationInTicks(US_TO_TICKS(duration_us));
+}
 uint8_t FastAccelStepper::getStepPin() { return _stepPin; }
 void FastAccelStepper::setDirectionPin(uint8_t dirPin, bool dirHighCountsUp) {
   _dirPin = dirPin;
@@ -546,6 +960,37 @@ int8_t FastAccelStepper::move(int32_t move) {
   }
   return _rg.move(move, &fas_queue[_queue_num].queue_end);
 }
+int8_t FastAccelStepper::moveInTime(int32_t move, uint32_t duration_ms) {
+  if ((move < 0) && (_dirPin == PIN_UNDEFINED)) {
+    return MOVE_ERR_NO_DIRECTION_PIN;
+  }
+  return _rg.moveInTime(move, duration_ms, &fas_queue[_queue_num].queue_end);
+}
+int8_t FastAccelStepper::moveToInTime(int32_t position, uint32_t duration_ms) {
+  return _rg.moveToInTime(position, duration_ms,
+                          &fas_queue[_queue_num].queue_end);
+}
+uint32_t FastAccelStepper::getRemainingTimeInUs() {
+  StepperQueue* q = &fas_queue[_queue_num];
+  uint32_t us = TICKS_TO_US(q->ticksInQueue());
+  if (_rg.isRampGeneratorActive()) {
+    uint32_t ramp_us = _rg.getRemainingTimeInUs(&q->queue_end);
+    us += ramp_us;
+    if (us < ramp_us) {
+      return 0xffffffff;
+    }
+  }
+  return us;
+}
+int8_t FastAccelStepper::queueMoveTo(int32_t position) {
+  return _rg.queueMoveTo(position, &fas_queue[_queue_num].queue_end);
+}
+int8_t FastAccelStepper::queueMove(int32_t move) {
+  if ((move < 0) && (_dirPin == PIN_UNDEFINED)) {
+    return MOVE_ERR_NO_DIRECTION_PIN;
+  }
+  return _rg.queueMove(move, &fas_queue[_queue_num].queue_end);
+}
 void FastAccelStepper::keepRunning() { _rg.setKeepRunning(); }
 void FastAccelStepper::stopMove() { _rg.initiate_stop(); }
 void FastAccelStepper::applySpeedAcceleration() {
@@ -574,17 +1019,32 @@ int8_t FastAccelStepper::moveByAcceleration(int32_t acceleration,
   }
   return res;
 }
+int8_t FastAccelStepper::setTargetSpeed(int32_t milli_hz) {
+  if ((milli_hz < 0) && (_dirPin == PIN_UNDEFINED)) {
+    return MOVE_ERR_NO_DIRECTION_PIN;
+  }
+  return _rg.setTargetSpeed(milli_hz);
+}
 void FastAccelStepper::forceStopAndNewPosition(uint32_t new_pos) {
   StepperQueue* q = &fas_queue[_queue_num];
 
   // first stop ramp generator
   _rg.stopRamp();
 
+  // the slaves of a coordinated move stop at their current position
+  for (uint8_t i = 0; i < _coord_slaves; i++) {
+    FastAccelStepper* slave = _coord[i].stepper;
+    slave->forceStopAndNewPosition(slave->getCurrentPosition());
+  }
+  _coord_slaves = 0;
+
   // stop the stepper interrupt and empty the queue
   q->forceStop();
 
   // set the new position
-  q->queue_end.pos = new_pos;
+  noInterrupts();
+  q->adjustPosition(new_pos - q->queue_end.pos);
+  interrupts();
 }
 bool FastAccelStepper::disableOutputs() {
   if (isRunning() && _autoEnable) {
@@ -679,14 +1139,14 @@ int32_t FastAccelStepper::getCurrentSpeedInMilliHz() {
 void FastAccelStepper::setCurrentPosition(int32_t new_pos) {
   int32_t delta = new_pos - getCurrentPosition();
   noInterrupts();
-  fas_queue[_queue_num].queue_end.pos += delta;
+  fas_queue[_queue_num].adjustPosition(delta);
   _rg.advanceTargetPositionWithinInterruptDisabledScope(delta);
   interrupts();
 }
 void FastAccelStepper::setPositionAfterCommandsCompleted(int32_t new_pos) {
   noInterrupts();
   int32_t delta = new_pos - fas_queue[_queue_num].queue_end.pos;
-  fas_queue[_queue_num].queue_end.pos = new_pos;
+  fas_queue[_queue_num].adjustPosition(delta);
   _rg.advanceTargetPositionWithinInterruptDisabledScope(delta);
   interrupts();
 }
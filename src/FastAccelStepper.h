@@ -29,10 +29,48 @@
 #define MIN_CMD_TICKS (10 * MIN_DELTA_TICKS)
 #define REF_CMD_TICKS (15 * MIN_DELTA_TICKS)
 
+// Range of setCommandDurationInUs(). The lower limit is the largest
+// MIN_CMD_TICKS of all targets (avr), so it is the same everywhere.
+#define MIN_CMD_DURATION_US 400
+#define MAX_CMD_DURATION_US 20000
+
 #define MAX_ON_DELAY_TICKS ((uint32_t)(65535 * (QUEUE_LEN - 1)))
 
 #define PIN_UNDEFINED 255
 
+// Statistics of the command queue collected by fill_queue() while the ramp
+// generator is active. See FastAccelStepper::getQueueStats()
+struct queue_stats_s {
+  // number of fill_queue() calls, which have measured the queue
+  uint32_t fills;
+  // number of times the queue has run empty, while the ramp has been running
+  uint32_t underruns;
+  // minimum ticks in queue found by fill_queue(). This does not include the
+  // command in execution. 0xffffffff without measurement
+  uint32_t min_lead_ticks;
+};
+
+// log2 histograms of the queue handling for diagnosis of jitter. Bin 0
+// counts the value 0, bin i the values 2^(i-1) to 2^i-1 and the last bin all
+// bigger values. If a bin reaches 65535, all bins of this histogram are
+// halved, so the distribution is kept. See FastAccelStepper::getLatencyStats()
+//
+// The histograms need 96 bytes of RAM per stepper and add run time to the
+// stepper ISR. They are recorded by default and can be disabled with build
+// flag FAS_LATENCY_STATS=0 to save RAM and ISR time.
+#ifndef FAS_LATENCY_STATS
+#define FAS_LATENCY_STATS 1
+#endif
+#define LATENCY_BINS 16
+struct latency_stats_s {
+  // run time of fill_queue() in us for an active ramp generator
+  uint16_t fill_us[LATENCY_BINS];
+  // commands added to the queue by these fill_queue() calls
+  uint16_t fill_commands[LATENCY_BINS];
+  // run time of the stepper ISR in ticks. ISR entry and exit are not included
+  uint16_t isr_ticks[LATENCY_BINS];
+};
+
 class FastAccelStepperEngine;
 
 class FastAccelStepper {
@@ -95,7 +133,9 @@ class FastAccelStepper {
 #define DELAY_TOO_LOW -1
 #define DELAY_TOO_HIGH -2
 
-  // Retrieve the current position of the stepper
+  // Retrieve the current position of the stepper. With the position counter
+  // of the ISR (FAS_POSITION_COUNTER=1, default for avr and esp32) this takes
+  // constant time independent of the queue fill level.
   int32_t getCurrentPosition();
 
   // Set the current position of the stepper - either in standstill or while
@@ -172,6 +212,48 @@ class FastAccelStepper {
   }
   uint32_t getAcceleration() { return _rg.getAcceleration(); }
 
+  //  setDeceleration expects as parameter the decrease of speed as step/s²
+  //  for all ramps slowing the stepper down: end of move, stopMove(),
+  //  reversing and speed reduction.
+  //  With deceleration = 0 (default) the acceleration value is used.
+  //  For a jerk limited ramp (setJerk() with jerk > 0), deceleration is
+  //  always the acceleration value.
+  //
+  // New value will be used after call to
+  // move/moveTo/runForward/runBackward/applySpeedAcceleration/moveByAcceleration
+  //
+  // Returns 0 on success, or -1 on invalid value (<0)
+  int8_t setDeceleration(int32_t step_s_s) {
+    return _rg.setDeceleration(step_s_s);
+  }
+  // returns the deceleration in use
+  uint32_t getDeceleration() { return _rg.getDeceleration(); }
+
+  //  setJerk expects as parameter the change of acceleration as step/s³.
+  //  With jerk > 0 the ramp generator creates a jerk limited ramp (S-curve):
+  //  The acceleration is ramped up/down with this rate at start from
+  //  standstill, at the transition to/from coasting and at stop.
+  //  If for example the acceleration of 1000 steps/s² should be reached
+  //  within 0.1s, then the jerk is 1000 steps/s² / 0.1s = 10000 steps/s³
+  //
+  //  A jerk limited ramp needs more time and steps for acceleration and
+  //  deceleration than the trapezoidal ramp with same acceleration.
+  //  If the speed is too low to reach the acceleration, the acceleration is
+  //  reduced to about sqrt(speed * jerk). A move from standstill, which is
+  //  too short for reaching the coasting speed, runs with a reduced speed,
+  //  so that the acceleration is ramped down to zero at the peak speed.
+  //  A move changed while running can still switch from acceleration to
+  //  deceleration without jerk limitation.
+  //
+  //  jerk = 0 selects the trapezoidal ramp (default)
+  //
+  // New value will be used after call to
+  // move/moveTo/runForward/runBackward/applySpeedAcceleration/moveByAcceleration
+  //
+  // Returns 0 on success
+  int8_t setJerk(uint32_t step_s_s_s) { return _rg.setJerk(step_s_s_s); }
+  uint32_t getJerk() { return _rg.getJerk(); }
+
   // getCurrentAcceleration() retrieves the actual acceleration.
   //	= 0 while idle or coasting
   //	> 0 while speed is changing towards positive values
@@ -196,6 +278,63 @@ class FastAccelStepper {
   -1 /* negative direction requested, but no direction pin defined */
 #define MOVE_ERR_SPEED_IS_UNDEFINED -2
 #define MOVE_ERR_ACCELERATION_IS_UNDEFINED -3
+#define MOVE_ERR_SEGMENT_QUEUE_FULL -4
+#define MOVE_ERR_COORDINATED_INVALID -5
+#define MOVE_ERR_DURATION_TOO_SHORT -6
+#define MOVE_ERR_SEGMENT_ACCELERATION_CHANGED -7
+
+  // moveInTime()/moveToInTime() start a move, which is completed after the
+  // given duration in ms. The speed is reduced, so that the move with the
+  // set acceleration/deceleration takes the given time (see doc/ramp.md).
+  // This way several independent steppers can be made to arrive at the same
+  // time. The reduced speed is used only for this move, setSpeedInUs() etc.
+  // are not affected.
+  //
+  // The calculation assumes the stepper to be at standstill and is not exact
+  // for jerk limited ramps.
+  //
+  // Returns MOVE_OK, MOVE_ERR_DURATION_TOO_SHORT, if the move cannot be
+  // completed in time with the set speed/acceleration, or error as for moveTo
+  int8_t moveInTime(int32_t move, uint32_t duration_ms);
+  int8_t moveToInTime(int32_t position, uint32_t duration_ms);
+
+  // getRemainingTimeInUs() estimates the time in us, until the running move
+  // and all queued segments are completed. The commands already in the queue
+  // are included. So this allows to wait for a move without polling
+  // isRunning(). The calculation assumes a trapezoidal ramp and uses 16 bit
+  // float math, so the estimate is only accurate to about 1%.
+  //
+  // Returns 0 for a stopped stepper and 0xffffffff for a stepper running
+  // continuously (or for more than approx. 71 minutes)
+  uint32_t getRemainingTimeInUs();
+  // getEstimatedCompletionTime() returns micros() at completion of the move.
+  // Like micros() it wraps around after approx. 71 minutes
+  uint32_t getEstimatedCompletionTime() {
+    return micros() + getRemainingTimeInUs();
+  }
+
+  // queueMoveTo() adds a move to an absolute position to the segment queue
+  // using the current speed/acceleration values. The segment is started,
+  // after the target of the running move or previous segment is reached.
+  // Consecutive moves in the same direction are blended: the stepper passes
+  // the intermediate target with the lower speed of both segments instead
+  // of coming to standstill. A direction change still stops at the target.
+  // If the ramp generator is not active, this is the same as moveTo().
+  // move/moveTo/runForward/runBackward discard all queued segments.
+  //
+  // Up to RAMP_SEGMENT_QUEUE_LEN (avr: 4, else 8) segments can be queued.
+  // Blending is not performed for jerk limited ramps. The speed can differ
+  // per segment, but all queued segments use the acceleration/jerk of the
+  // first queued segment.
+  //
+  // Returns MOVE_OK, MOVE_ERR_SEGMENT_QUEUE_FULL,
+  // MOVE_ERR_SEGMENT_ACCELERATION_CHANGED for changed acceleration/jerk
+  // while segments are queued, or error as for moveTo
+  int8_t queueMoveTo(int32_t position);
+  // queueMove() is relative to the target of the last queued segment
+  int8_t queueMove(int32_t move);
+  // number of queued segments not yet started
+  uint8_t queuedSegments() { return _rg.queuedSegments(); }
 
   // This command flags the stepper to keep run continuously into current
   // direction. It can be stopped by stopMove.
@@ -231,12 +370,29 @@ class FastAccelStepper {
   // return value as with move/moveTo
   int8_t moveByAcceleration(int32_t acceleration, bool allow_reverse = true);
 
+  // setTargetSpeed() lets the stepper run continuously with the given speed in
+  // milliHertz. The sign selects the direction. The ramp generator follows
+  // the target speed with the set acceleration and reverses direction, if
+  // needed. With target speed 0 the stepper decelerates to standstill.
+  // The speed set by setSpeedInUs()/setSpeedInHz()/... is the upper limit.
+  //
+  // The function is intended to be called frequently (e.g. 1 kHz) for
+  // velocity control: on a running stepper only the target speed is updated.
+  // Changes of the acceleration need a call to applySpeedAcceleration().
+  //
+  // Returns MOVE_OK, MOVE_ERR_NO_DIRECTION_PIN for negative speed without
+  // direction pin, MOVE_ERR_SPEED_IS_UNDEFINED or
+  // MOVE_ERR_ACCELERATION_IS_UNDEFINED
+  int8_t setTargetSpeed(int32_t milli_hz);
+
   // stop the running stepper as fast as possible with deceleration
   // This only sets a flag and can be called from an interrupt !
   void stopMove();
   bool isStopping() { return _rg.isStopping(); }
 
   // stop the running stepper immediately and set new_pos as new position
+  // The slaves of a coordinated move are stopped, too, and keep their
+  // current position.
   // This can be called from an interrupt !
   void forceStopAndNewPosition(uint32_t new_pos);
 
@@ -268,11 +424,88 @@ class FastAccelStepper {
 #define AQE_ERROR_TICKS_TOO_LOW -1
 #define AQE_ERROR_EMPTY_QUEUE_TO_START -2
 #define AQE_ERROR_NO_DIR_PIN_TO_TOGGLE -3
+#define AQE_ERROR_INVALID_REPEAT -4
+#define AQE_ERROR_STEPS_TOO_HIGH -6 /* steps exceed MAX_CMD_STEPS */
+
+  // addRepeatedPause() adds a pause of (repeat + 1) * ticks with one queue
+  // entry. The ISR repeats the pause, so long or periodic pauses need
+  // neither more queue entries nor more calls. repeat is limited to
+  // MAX_PAUSE_REPEAT (15 on avr, 255 on esp32). Identical step commands need
+  // no repeat, because they are already combined by the steps count.
+  // Return codes as for addQueueEntry() or AQE_ERROR_INVALID_REPEAT
+  int8_t addRepeatedPause(uint16_t ticks, uint8_t repeat, bool start = true);
+
+  // addMarker() adds a pause of ticks with a tag (1..255) to the queue, e.g.
+  // to trigger a camera at an exact position of a raw command sequence.
+  // When the marker becomes the current entry of the queue, i.e. with the
+  // last step in front and before the pause of the marker, the tag is put
+  // into a ring of 8 events. A marker added to an empty queue is reported at
+  // once. getMarkerEvent() returns the tags in order of execution or 0 for
+  // no event. If the ring is full, the tag is dropped and counted by
+  // getLostMarkerEvents().
+  // Return codes as for addQueueEntry() or AQE_ERROR_INVALID_TAG for tag 0
+#define AQE_ERROR_INVALID_TAG -5
+  int8_t addMarker(uint8_t tag, uint16_t ticks = MIN_CMD_TICKS,
+                   bool start = true);
+  uint8_t getMarkerEvent();
+  uint8_t getLostMarkerEvents();
+
+  // addQueueEntries() adds up to n commands with one call, e.g. for streaming
+  // of host generated trajectories. The first command is added like with
+  // addQueueEntry() including auto enable. All further commands are copied
+  // into the queue and made visible to the interrupt at once.
+  //
+  // Adding stops at a full queue or the first rejected command. The reason
+  // for rejection can be retrieved by calling addQueueEntry() for it.
+  // Returns the number of added commands.
+  uint16_t addQueueEntries(const struct stepper_command_s* cmds, uint16_t n,
+                           bool start = true);
 
   // check function s for command queue being empty or full
   bool isQueueEmpty();
   bool isQueueFull();
 
+  // The ramp generator fills the queue with commands for the next 20ms
+  // (lookahead) and each command covers approx. 2ms (command duration).
+  //
+  // setLookAheadInMs() allows to adjust the lookahead. If min_ms < max_ms,
+  // then the lookahead adapts to the measured queue depth on each fill:
+  // If the queue has been drained below 1/4 of the lookahead, it is increased
+  // by 50% up to max_ms. If the queue stays above 3/4 of the lookahead, it is
+  // slowly reduced down to min_ms. A longer lookahead is robust against late
+  // calls of the fill task, a shorter one reacts faster on speed changes.
+  // Returns 0 or -1 for invalid values (min_ms = 0 or min_ms > max_ms)
+  int8_t setLookAheadInMs(uint16_t min_ms, uint16_t max_ms);
+  uint32_t getLookAheadInUs() { return TICKS_TO_US(_lookahead_ticks); }
+
+  // setCommandDurationInUs() sets the duration of one command at high speeds.
+  // Longer commands reduce cpu load and queue usage, shorter commands allow
+  // finer speed resolution of the ramp. Valid range is MIN_CMD_DURATION_US
+  // (400us) to MAX_CMD_DURATION_US (20ms). Returns 0 or -1 for invalid value
+  int8_t setCommandDurationInUs(uint32_t duration_us);
+  uint32_t getCommandDurationInUs() {
+    return TICKS_TO_US(_rg.getCommandDurationInTicks());
+  }
+
+  // getQueueStats() retrieves the statistics of the queue for the running
+  // ramp. An underrun means, that fill_queue() has not been called in time
+  // and the stepper has stopped in the middle of the ramp. A low
+  // min_lead_ticks shows, how close the queue has been to an underrun. Both
+  // help to size lookahead and command duration (see above).
+  // The values are accumulated until resetQueueStats()
+  void getQueueStats(struct queue_stats_s* stats);
+  void resetQueueStats();
+
+#if (FAS_LATENCY_STATS == 1)
+  // getLatencyStats() retrieves the histograms of the fill_queue() run time,
+  // the commands per fill_queue() and the stepper ISR run time. These are
+  // accumulated until resetLatencyStats(). On avr only the ISR calls, which
+  // finish a command or issue the delayed step after the queue has run out,
+  // are recorded. These include the longest path.
+  void getLatencyStats(struct latency_stats_s* stats);
+  void resetLatencyStats();
+#endif
+
   // Get the future position of the stepper after all commands in queue are
   // completed
   int32_t getPositionAfterCommandsCompleted();
@@ -357,11 +590,41 @@ class FastAccelStepper {
 
  private:
   void fill_queue();
+  void _adaptLookAhead(uint32_t ticks_in_queue);
+  int8_t _addQueueEntry(const struct stepper_command_s* cmd, bool start,
+                        uint8_t repeat, uint8_t tag);
   void updateAutoDisable();
   bool needAutoDisable();
   bool agreeWithAutoDisable();
   bool usesAutoEnablePin(uint8_t pin);
 
+  // Coordinated move: the master distributes the steps of the other steppers
+  // (slaves) along its own commands using bresenham. pending_ticks/steps is
+  // the part of the master timeline, which is not yet in the slave's queue.
+  struct coordinated_slave_s {
+    FastAccelStepper* stepper;
+    uint32_t steps;
+    uint32_t err;
+    uint32_t pending_ticks;
+    uint32_t pending_steps;
+    bool count_up;
+  };
+  bool _coordinatedSlavesReady();
+  void _coordinatedFollow(const struct stepper_command_s* cmd);
+  bool _coordinatedFlush(struct coordinated_slave_s* c, bool final);
+  void _coordinatedStart(bool start_master);
+  void _coordinatedFinish();
+  uint8_t _coord_slaves;
+  uint32_t _coord_master_steps;
+  struct coordinated_slave_s _coord[MAX_STEPPER - 1];
+
+  // planning horizon of fill_queue()
+  uint32_t _lookahead_ticks;
+  uint32_t _min_lookahead_ticks;
+  uint32_t _max_lookahead_ticks;
+  // ramp generator has been active at end of last fill_queue()
+  bool _fill_ramp_active;
+
   FastAccelStepperEngine* _engine;
   bool (*_externalEnableCall)(uint8_t enablePin, uint8_t value);
   RampGenerator _rg;
@@ -415,6 +678,44 @@ class FastAccelStepperEngine {
   // This should be only called from ISR or stepper task
   void manageSteppers();
 
+  // startQueues() starts the prepared queues of several steppers together.
+  // The commands have to be added with addQueueEntry(cmd, false) before.
+  // Bit n of stepper_mask selects the n-th stepper returned by
+  // stepperConnectToPin(). Steppers, which are already running, are not
+  // affected.
+  //
+  // On avr all steppers share one timer and the first step of all selected
+  // steppers is scheduled for the same timer compare value. So they start on
+  // the same tick. On esp32 the timers are started back to back with
+  // interrupts disabled.
+  //
+  // Returns AQE_OK or AQE_ERROR_EMPTY_QUEUE_TO_START, if the queue of a
+  // selected stepper is empty. In the latter case no stepper is started.
+  int8_t startQueues(uint8_t stepper_mask);
+
+  // Coordinated move of several steppers along a straight line.
+  //
+  // All steppers start together and reach their target position at the same
+  // time. The stepper with the most steps to go is the master and generates
+  // the ramp. Its speed, acceleration and deceleration are reduced for this
+  // move, so that none of the steppers exceeds its own settings. The other
+  // steppers follow the master step by step, so the deviation from the
+  // straight line stays within about one step.
+  //
+  // Preconditions: none of the steppers is running, speed and acceleration
+  // are set for all steppers and steppers moving backward have a direction
+  // pin. Jerk limited ramps are not supported. If auto enable is used, all
+  // steppers should use the same delayToEnable.
+  //
+  // stopMove() of the master stops all steppers on the line.
+  // forceStopAndNewPosition() of the master stops all steppers immediately.
+  // The other steppers must not be commanded until all steppers have
+  // stopped.
+  //
+  // Returns MOVE_OK, MOVE_ERR_COORDINATED_INVALID or error as for moveTo
+  int8_t moveToCoordinated(FastAccelStepper* steppers[],
+                           const int32_t positions[], uint8_t count);
+
  private:
   bool isDirPinBusy(uint8_t dirPin, uint8_t except_stepper);
 
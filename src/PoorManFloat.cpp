@@ -347,6 +347,29 @@ upm_float upm_rsqrt(upm_float x) {  // TESTED
   }
   return UPM_FROM_PARTS(mantissa, exponent);
 }
+// The cubic root has no table. The exponent is split into a multiple of three
+// and a remainder 0..2. The remainder is shifted into the mantissa, which then
+// represents 1.0 to ~8.0. The 9 bit result mantissa is determined bit by bit
+// by comparing its cube against the shifted mantissa.
+upm_float upm_cbrt(upm_float x) {  // TESTED
+  uint8_t mantissa = x & 0x00ff;
+  int16_t exponent = (int16_t)(x >> 8) - 128;
+  int16_t exp_div3 = exponent / 3;
+  int16_t exp_rem = exponent - 3 * exp_div3;
+  if (exp_rem < 0) {
+    exp_rem += 3;
+    exp_div3 -= 1;
+  }
+  uint32_t target = ((uint32_t)(mantissa | 0x100)) << (16 + exp_rem);
+  uint16_t res = 0x100;
+  for (uint8_t bit = 0x80; bit != 0; bit >>= 1) {
+    uint32_t y = res | bit;
+    if (y * y * y <= target) {
+      res = y;
+    }
+  }
+  return UPM_FROM_PARTS(res & 0xff, exp_div3 + 128);
+}
 upm_float upm_rsquare(upm_float x) {  // TESTED
   uint8_t mantissa = x & 0x00ff;
   uint8_t exponent = x >> 8;
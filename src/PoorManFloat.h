@@ -28,6 +28,7 @@ upm_float upm_reciprocal(upm_float x);             // TESTED
 upm_float upm_square(upm_float x);                 // TESTED = x*x
 upm_float upm_rsquare(upm_float x);  // TESTED Reciprocal square = 1/(x*x)
 upm_float upm_rsqrt(upm_float x);    // TESTED. Reciprocal sqrt() = 1/sqrt(x)
+upm_float upm_cbrt(upm_float x);     // TESTED. Cubic root
 
 // OLD
 upm_float upm_divide(upm_float x, upm_float y);
@@ -214,6 +214,158 @@ uint32_t calculate_ticks_v8(uint32_t steps, upm_float pre_calc) {
   return res;
 }
 
+// Integer square root by the bitwise method: 16 iterations
+uint16_t fixed_isqrt(uint32_t x) {
+  uint32_t res = 0;
+  uint32_t bit = (uint32_t)1 << 30;
+  while (bit > x) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (x >= res + bit) {
+      x -= res + bit;
+      res = (res >> 1) + bit;
+    } else {
+      res >>= 1;
+    }
+    bit >>= 2;
+  }
+  return res;
+}
+// Returns sqrt(x) * 2^k with 16 significant bits, x must not be 0
+static uint16_t fixed_norm_sqrt(uint32_t x, uint8_t *k) {
+  uint8_t shift = __builtin_clz(x) >> 1;
+  *k = shift;
+  return fixed_isqrt(x << (shift << 1));
+}
+uint32_t calculate_sqrt_inv_accel_fixed(uint32_t ticks_per_s, uint32_t accel) {
+  if (accel == 0) {
+    return 0;
+  }
+  uint8_t k;
+  // accel < 2^31, so 2*accel does not overflow
+  uint16_t r = fixed_norm_sqrt(accel << 1, &k);
+  uint64_t res = ((uint64_t)ticks_per_s << (8 + k)) / r;
+  if (res > 0xffffffff) {
+    return 0xffffffff;
+  }
+  return res;
+}
+uint32_t calculate_ticks_fixed(uint32_t steps, uint32_t sqrt_inv_accel) {
+  if (steps == 0) {
+    steps = 1;
+  }
+  uint8_t k;
+  uint16_t r = fixed_norm_sqrt(steps, &k);
+  // sqrt_inv_accel < 2^32 and k <= 15, so this fits into 47 bits
+  uint64_t ticks = ((uint64_t)sqrt_inv_accel << k) / r;
+  // remove the 8 fractional bits with rounding
+  return (ticks + 128) >> 8;
+}
+uint32_t calculate_ramp_steps_fixed(uint32_t ticks, uint32_t sqrt_inv_accel) {
+  if (ticks == 0) {
+    return 0xffffffff;
+  }
+  // speed in steps/s with 12 fractional bits: < 2^36/ticks
+  uint64_t v = ((uint64_t)sqrt_inv_accel << 4) / ticks;
+  if (v > 0xffffffff) {
+    return 0xffffffff;
+  }
+  uint64_t steps = (v * v) >> 24;
+  if (steps > 0xffffffff) {
+    return 0xffffffff;
+  }
+  return steps;
+}
+
+// The generation counter is a seqlock with a single writer. The fences order
+// the table writes/reads against the generation on both cores of the esp32.
+#define RAMP_TABLE_GEN_LOAD() __atomic_load_n(&_generation, __ATOMIC_ACQUIRE)
+#define RAMP_TABLE_GEN_STORE(val) \
+  __atomic_store_n(&_generation, (uint8_t)(val), __ATOMIC_RELEASE)
+#define RAMP_TABLE_GEN_RECHECK(gen) \
+  (__atomic_thread_fence(__ATOMIC_ACQUIRE), (_generation == (gen)))
+
+void RampTable::build(upm_float pre_calc) {
+  // odd generation: table is invalid during build
+  uint8_t gen = _generation | 1;
+  RAMP_TABLE_GEN_STORE(gen);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  uint8_t idx = 0;
+  for (uint8_t e = 0; e <= RAMP_TABLE_OCTAVES; e++) {
+    for (uint8_t k = 0; k < (1 << RAMP_TABLE_SUB_BITS); k++) {
+      // steps = 2^e * (1 + k/2^sub_bits)
+      upm_float upm_steps = upm_shr(
+          upm_shl(upm_from((uint8_t)((1 << RAMP_TABLE_SUB_BITS) + k)), e),
+          RAMP_TABLE_SUB_BITS);
+      uint32_t res =
+          upm_to_u32(upm_multiply(pre_calc, upm_rsqrt(upm_steps)));
+      _ticks[idx++] = (res > 65535) ? 0 : res;
+      if (idx == RAMP_TABLE_SIZE) {
+        break;
+      }
+    }
+  }
+  _pre_calc = pre_calc;
+  // the table must be complete, before it is marked valid
+  RAMP_TABLE_GEN_STORE(gen + 1);
+}
+bool RampTable::isValidFor(upm_float pre_calc) const {
+  uint8_t gen = RAMP_TABLE_GEN_LOAD();
+  if (gen & 1) {
+    return false;
+  }
+  bool valid = (_pre_calc == pre_calc);
+  return valid && RAMP_TABLE_GEN_RECHECK(gen);
+}
+uint32_t RampTable::ticks(uint32_t steps, upm_float pre_calc) const {
+  if ((steps == 0) || (steps >= ((uint32_t)1 << RAMP_TABLE_OCTAVES))) {
+    return 0;
+  }
+  uint8_t gen = RAMP_TABLE_GEN_LOAD();
+  if ((gen & 1) || (_pre_calc != pre_calc)) {
+    return 0;
+  }
+  // e = position of msb of steps
+  uint8_t e = 0;
+  uint32_t s = steps;
+  if (s >= 0x10000) {
+    s >>= 16;
+    e += 16;
+  }
+  if (s >= 0x100) {
+    s >>= 8;
+    e += 8;
+  }
+  while (s > 1) {
+    s >>= 1;
+    e++;
+  }
+  uint8_t idx = e << RAMP_TABLE_SUB_BITS;
+  if (e <= RAMP_TABLE_SUB_BITS) {
+    // no interpolation necessary
+    idx |= (steps << (RAMP_TABLE_SUB_BITS - e)) &
+           ((1 << RAMP_TABLE_SUB_BITS) - 1);
+    uint16_t t = _ticks[idx];
+    return RAMP_TABLE_GEN_RECHECK(gen) ? t : 0;
+  }
+  uint8_t frac_bits = e - RAMP_TABLE_SUB_BITS;
+  idx |= (steps >> frac_bits) & ((1 << RAMP_TABLE_SUB_BITS) - 1);
+  uint32_t frac = steps & ((((uint32_t)1) << frac_bits) - 1);
+  // limit the fraction to 8 bits to avoid overflow in the multiplication
+  if (frac_bits > 8) {
+    frac >>= frac_bits - 8;
+    frac_bits = 8;
+  }
+  uint16_t t0 = _ticks[idx];
+  uint16_t t1 = _ticks[idx + 1];
+  if ((t0 == 0) || !RAMP_TABLE_GEN_RECHECK(gen)) {
+    return 0;
+  }
+  uint32_t delta = (uint32_t)(t0 - t1) * frac;
+  return t0 - (uint16_t)(delta >> frac_bits);
+}
+
 #ifdef TEST
 uint32_t calculate_ticks_v9(uint32_t steps, upm_float pre_calc) {
   upm_float upm_steps = upm_from(steps);
@@ -1,3 +1,5 @@
+#ifndef RAMP_CALCULATOR_H
+#define RAMP_CALCULATOR_H
 #include <stdint.h>
 
 #include "PoorManFloat.h"
@@ -15,3 +17,42 @@ uint32_t calculate_ticks_v8(uint32_t steps, upm_float pre_calc);
 #ifdef TEST
 uint32_t calculate_ticks_v9(uint32_t steps, upm_float pre_calc);
 #endif
+
+// Fixed point alternative to the upm_float based calculation for 32 bit
+// targets. sqrt_inv_accel is ticks_per_s/sqrt(2*accel) in 24.8 fixed point.
+//	ticks = sqrt_inv_accel / sqrt(steps)
+//	steps = (sqrt_inv_accel / ticks)²
+uint16_t fixed_isqrt(uint32_t x);
+uint32_t calculate_sqrt_inv_accel_fixed(uint32_t ticks_per_s, uint32_t accel);
+uint32_t calculate_ticks_fixed(uint32_t steps, uint32_t sqrt_inv_accel);
+uint32_t calculate_ramp_steps_fixed(uint32_t ticks, uint32_t sqrt_inv_accel);
+
+// The ramp table stores calculate_ticks_v8() results for ramp steps 2^e with
+// RAMP_TABLE_SUB_BITS sub steps per octave. In between the ticks are linearly
+// interpolated. Ticks above 65535 are not stored and for those ramp steps,
+// ticks() returns 0, so the caller needs to fall back to calculate_ticks_v8().
+#define RAMP_TABLE_OCTAVES 20
+#define RAMP_TABLE_SUB_BITS 2
+#define RAMP_TABLE_SIZE ((RAMP_TABLE_OCTAVES << RAMP_TABLE_SUB_BITS) + 1)
+//
+// On esp32 build() runs in the application task, while ticks() is called by
+// fill_queue() possibly on the other core. So the table is protected by a
+// generation counter, which is odd during build(). The readers snapshot the
+// generation before and recheck it after the lookup. On mismatch or for a
+// table of another acceleration (pre_calc) the lookup is treated as miss.
+class RampTable {
+ public:
+  void init() {
+    _generation = 1;
+    _pre_calc = 0;
+  }
+  void build(upm_float pre_calc);
+  bool isValidFor(upm_float pre_calc) const;
+  uint32_t ticks(uint32_t steps, upm_float pre_calc) const;
+
+ private:
+  uint16_t _ticks[RAMP_TABLE_SIZE];
+  upm_float _pre_calc;
+  volatile uint8_t _generation;
+};
+#endif
@@ -33,23 +33,55 @@
 //
 //	    v = sqrt(2 * s * a)
 //
+// For deceleration d different from acceleration a, the ramp steps are
+// counted in units of the deceleration: s = 1/2 * v² / d. So the ramp steps
+// are always the steps needed to come to standstill and the deceleration
+// starts, when the remaining steps reach the ramp steps. On acceleration, one
+// step increases the ramp steps by a/d.
+//
 //*************************************************************************************************
 
 void RampGenerator::init() {
   speed_in_ticks = 0;
+  acceleration = 0;
+  deceleration = 0;
+  jerk = 0;
   _config.accel_change_cnt = 0;
   _config.min_travel_ticks = 0;
   _config.upm_inv_accel2 = 0;
+#if (FAS_RAMP_MATH_FIXED == 1)
+  _config.sqrt_inv_accel_fixed = 0;
+#endif
+  _config.accel_ramp_factor = 0x10000;
+  _config.upm_accel_plan_factor = 0;
+  _config.jerk_bottom_steps = 0;
+  _config.jerk_top_start_steps = 0;
+  _config.jerk_top_steps = 0;
+  _config.upm_jerk_bottom = 0;
+  _config.upm_jerk_inv_2top = 0;
+#if (FAS_RAMP_TABLE == 1)
+  _table.init();
+#endif
   _ro.target_pos = 0;
+  _ro.exit_ramp_steps = 0;
+  _ro.target_ticks = 0;
+  _seg_read_idx = 0;
+  _seg_write_idx = 0;
+  _seg_active_junction = 0;
+  _seg_last_target = 0;
+  _seg_last_count_up = true;
+  _seg_config = _config;
   _rw.pause_ticks_left = 0;
   _rw.performed_ramp_up_steps = 0;
+  _rw.ramp_steps_frac = 0;
   _rw.accel_change_cnt = 0xff;
   _rw.ramp_state = RAMP_STATE_IDLE;
   _rw.curr_ticks = TICKS_FOR_STOPPED_MOTOR;
 #if (TICKS_PER_S != 16000000L)
   upm_timer_freq = upm_from((uint32_t)TICKS_PER_S);
-  upm_timer_freq_div_500 = upm_divide(upm_timer_freq, UPM_CONST_500);
 #endif
+  // Forward planning of 2ms
+  setCommandDurationInTicks(TICKS_PER_S / 500);
 }
 int8_t RampGenerator::setSpeedInTicks(uint32_t min_step_ticks) {
   if (min_step_ticks < MIN_DELTA_TICKS) {
@@ -60,6 +92,11 @@ int8_t RampGenerator::setSpeedInTicks(uint32_t min_step_ticks) {
   }
   speed_in_ticks = min_step_ticks;
   _config.min_travel_ticks = min_step_ticks;
+  if (jerk != 0) {
+    // the peak acceleration of the jerk limited ramp depends on the speed
+    _updateRampConfig();
+  }
+  _updateJerkConfig();
   return 0;
 }
 int8_t RampGenerator::setSpeedInUs(uint32_t min_step_us) {
@@ -69,35 +106,379 @@ int8_t RampGenerator::setSpeedInUs(uint32_t min_step_us) {
   uint32_t min_step_ticks = US_TO_TICKS(min_step_us);
   return setSpeedInTicks(min_step_ticks);
 }
+int8_t RampGenerator::setCommandDurationInTicks(uint32_t cmd_ticks) {
+  if ((cmd_ticks < MIN_CMD_TICKS) || (cmd_ticks > TICKS_PER_S / 50)) {
+    return -1;
+  }
+  _cmd_ticks = cmd_ticks;
+  _upm_cmd_ticks = upm_from(cmd_ticks);
+  return 0;
+}
 int8_t RampGenerator::setAcceleration(int32_t accel) {
   if (accel <= 0) {
     return -1;
   }
   acceleration = (uint32_t)accel;
+  _updateRampConfig();
+  _updateJerkConfig();
+  return 0;
+}
+int8_t RampGenerator::setDeceleration(int32_t decel) {
+  if (decel < 0) {
+    return -1;
+  }
+  deceleration = (uint32_t)decel;
+  _updateRampConfig();
+  _updateJerkConfig();
+  return 0;
+}
+upm_float RampGenerator::_invAccel2(uint32_t decel) {
 #ifdef UPM_ACCEL_FACTOR
-  upm_float upm_inv_accel2 =
-      upm_divide(UPM_ACCEL_FACTOR, upm_from((uint32_t)accel));
+  return upm_divide(UPM_ACCEL_FACTOR, upm_from(decel));
 #else
   upm_float upm_inv_accel =
-      upm_divide(upm_shr(UPM_TICKS_PER_S, 1), upm_from(accel));
-  upm_float upm_inv_accel2 = upm_multiply(UPM_TICKS_PER_S, upm_inv_accel);
+      upm_divide(upm_shr(UPM_TICKS_PER_S, 1), upm_from(decel));
+  return upm_multiply(UPM_TICKS_PER_S, upm_inv_accel);
 #endif
+}
+void RampGenerator::_updateRampConfig() {
+  if (acceleration == 0) {
+    return;
+  }
+  uint32_t accel = acceleration;
+  uint32_t decel = getDeceleration();
+  if ((jerk != 0) && (speed_in_ticks != 0)) {
+    // jerk limited ramp is symmetric and may use a reduced acceleration
+    accel = _jerkPeakAccel(speed_in_ticks);
+    decel = accel;
+  }
+  upm_float upm_inv_accel2 = _invAccel2(decel);
   if (_config.upm_inv_accel2 != upm_inv_accel2) {
     _config.upm_inv_accel2 = upm_inv_accel2;
 
-    // This is A = f / sqrt(2*a) = (f/sqrt(2))*rsqrt(a)
-    _config.upm_sqrt_inv_accel = upm_multiply(
-        upm_rsqrt(upm_from((uint32_t)accel)), UPM_TICKS_PER_S_DIV_SQRT_OF_2);
+    // This is A = f / sqrt(2*d) = (f/sqrt(2))*rsqrt(d)
+    _config.upm_sqrt_inv_accel =
+        upm_multiply(upm_rsqrt(upm_from(decel)), UPM_TICKS_PER_S_DIV_SQRT_OF_2);
     _config.accel_change_cnt = _rw.accel_change_cnt + 1;
+#if (FAS_RAMP_TABLE == 1)
+    // The running ramp uses the table only, if the acceleration matches.
+    _table.build(_config.upm_sqrt_inv_accel);
+#endif
+  }
+#if (FAS_RAMP_MATH_FIXED == 1)
+  _config.sqrt_inv_accel_fixed =
+      calculate_sqrt_inv_accel_fixed(TICKS_PER_S, decel);
+#endif
+
+  uint32_t factor = 0x10000;
+  upm_float upm_plan_factor = 0;
+  if (decel != accel) {
+    upm_float upm_a = upm_from(accel);
+    upm_float upm_d = upm_from(decel);
+    // a/d in 16.16 fixed point limited to 1/65536..255, so that
+    // 255 steps * factor does not overflow
+    uint32_t f = upm_to_u32(upm_shl(upm_divide(upm_a, upm_d), 16));
+    f = max(f, 1);
+    factor = min(f, 0xffffff);
+    // d/(a+d). Both values are < 2^31, so the sum does not overflow
+    upm_plan_factor = upm_divide(upm_d, upm_from(accel + decel));
   }
+  _config.accel_ramp_factor = factor;
+  _config.upm_accel_plan_factor = upm_plan_factor;
+}
+int8_t RampGenerator::setJerk(uint32_t new_jerk) {
+  jerk = new_jerk;
+  // jerk limited ramp uses acceleration for deceleration, too
+  _updateRampConfig();
+  _updateJerkConfig();
   return 0;
 }
+//*************************************************************************************************
+// Jerk limited ramp (S-curve)
+//
+// The trapezoidal ramp links the speed to the ramp steps r by v = sqrt(2*a*r).
+// For the jerk limited ramp, the ramp steps r are mapped to the equivalent
+// ramp steps p of the trapezoidal ramp and then v = sqrt(2*a*p). As the
+// mapping is the same for acceleration and deceleration, the ramp steps keep
+// the meaning of "steps needed to come to standstill" and the existing logic
+// for starting the deceleration is unchanged.
+//
+// With jerk j, the acceleration reaches a after t_j = a/j. Three regions:
+//
+// 1. Start from standstill with constant jerk: s = j*t³/6 and v = j*t²/2
+//    This phase ends at r_j = a³/(6*j²) with v_j = a²/(2*j), thus
+//		p = 3/4 * r_j * (r/r_j)^(4/3) = K_b * r * cbrt(r)
+//		with K_b = 3/4 / cbrt(r_j)
+//
+// 2. Constant acceleration. Continuity with region 1 gives:
+//		p = r - r_j/4
+//
+// 3. Transition to coasting speed v_max. The acceleration is reduced
+//    linearly over D = v_max * a / j steps, which limits the jerk to
+//    v * a/D <= j. With u being the steps into this region:
+//		p = p_1 + u - u²/(2*D)
+//    At u = D the speed v_max is reached with zero acceleration.
+//    For speeds above v_max (deceleration after speed reduction), the
+//    mapping continues with constant acceleration.
+//
+// Region 1 and 3 need p = a³/(8*j²) + v_max*a/(2*j) <= v_max²/(2*a). If
+// v_max is too low for this, the acceleration is reduced to the peak
+// acceleration a_p = sqrt(k*v_max*j) with k = 2*(sqrt(2)-1). Then region 2 is
+// empty and region 1 and 3 form a ramp with jerk j.
+//
+// A move from standstill, which is too short to reach v_max with this ramp,
+// runs with a reduced v_max for this move only. So the acceleration goes
+// to zero at the peak speed of the move, instead of switching from
+// acceleration to deceleration.
+//*************************************************************************************************
+uint32_t RampGenerator::_jerkPeakAccel(uint32_t ticks) {
+  // k*v*j = k*f*j/ticks with k = 13/16 slightly below 2*(sqrt(2)-1)
+  upm_float upm_kvj = upm_divide(
+      upm_multiply(upm_shr(upm_from((uint8_t)13), 4),
+                   upm_multiply(UPM_TICKS_PER_S, upm_from(jerk))),
+      upm_from(ticks));
+  uint32_t peak = upm_to_u32(upm_multiply(upm_kvj, upm_rsqrt(upm_kvj)));
+  return max(min(peak, acceleration), 1);
+}
+uint32_t RampGenerator::_jerkRampSteps(uint32_t ticks, uint32_t *bottom_steps,
+                                       uint32_t *top_steps) {
+  uint32_t accel = _jerkPeakAccel(ticks);
+  upm_float upm_a = upm_from(accel);
+  upm_float upm_j = upm_from(jerk);
+
+  // r_j = a³/(6*j²)
+  *bottom_steps = upm_to_u32(
+      upm_divide(upm_multiply(upm_a, upm_square(upm_a)),
+                 upm_multiply(upm_from((uint8_t)6), upm_square(upm_j))));
+
+  // D = v_max * a / j = f * a / (j * ticks)
+  upm_float upm_ticks = upm_from(ticks);
+  *top_steps = upm_to_u32(upm_divide(upm_multiply(UPM_TICKS_PER_S, upm_a),
+                                     upm_multiply(upm_j, upm_ticks)));
+
+  // equivalent trapezoidal ramp steps at coasting speed
+  return upm_to_u32(upm_multiply(_invAccel2(accel), upm_rsquare(upm_ticks)));
+}
+uint32_t RampGenerator::_jerkStartTicks(int32_t target_pos,
+                                        int32_t curr_pos) {
+  uint32_t ticks = speed_in_ticks;
+  if ((jerk == 0) || (acceleration == 0) || (ticks == 0) ||
+      isRampGeneratorActive()) {
+    return ticks;
+  }
+  int32_t delta = target_pos - curr_pos;
+  uint32_t steps = (delta < 0) ? -delta : delta;
+  for (uint8_t i = 0; i < 16; i++) {
+    uint32_t bottom_steps;
+    uint32_t top_steps;
+    uint32_t max_steps = _jerkRampSteps(ticks, &bottom_steps, &top_steps);
+    // ramp steps at v_max are top_start_steps + top_steps
+    uint32_t up_steps = max_steps + (top_steps >> 1) + (bottom_steps >> 2);
+    if (up_steps <= (steps >> 1)) {
+      return ticks;
+    }
+    if (ticks >= 0x7fffffff) {
+      break;
+    }
+    if (i == 0) {
+      // up_steps grows with v^(3/2) for reduced and v² for full
+      // acceleration, so ticks * q^(2/3) with q = 2*up_steps/steps is a
+      // good guess
+      upm_float upm_q =
+          upm_divide(upm_from(up_steps), upm_from(max(steps >> 1, 1)));
+      upm_float upm_t =
+          upm_multiply(upm_from(ticks), upm_cbrt(upm_square(upm_q)));
+      ticks = min(upm_to_u32(upm_t), 0x7fffffff);
+    } else {
+      ticks = min(ticks + (ticks >> 4), 0x7fffffff);
+    }
+  }
+  return ticks;
+}
+void RampGenerator::_updateJerkConfig() {
+  uint32_t bottom_steps = 0;
+  uint32_t top_start_steps = 0;
+  uint32_t top_steps = 0;
+  upm_float upm_bottom = 0;
+  upm_float upm_inv_2top = 0;
+  if ((jerk != 0) && (acceleration != 0) && (speed_in_ticks != 0)) {
+    uint32_t max_steps =
+        _jerkRampSteps(speed_in_ticks, &bottom_steps, &top_steps);
+    if (bottom_steps > 0) {
+      // K_b = 3/4 / cbrt(r_j)
+      upm_bottom = upm_divide(upm_shr(upm_from((uint8_t)3), 2),
+                              upm_cbrt(upm_from(bottom_steps)));
+    }
+    uint32_t bottom_end = bottom_steps - (bottom_steps >> 2);
+    if (max_steps < bottom_end + (top_steps >> 1)) {
+      // only due to rounding with the peak acceleration
+      if (max_steps > bottom_end) {
+        top_steps = (max_steps - bottom_end) << 1;
+      } else {
+        top_steps = 0;
+      }
+    }
+    top_start_steps = max_steps - (top_steps >> 1) + (bottom_steps >> 2);
+    if (top_steps > 0) {
+      upm_inv_2top = upm_shr(upm_reciprocal(upm_from(top_steps)), 1);
+    }
+  }
+  if ((_config.jerk_bottom_steps != bottom_steps) ||
+      (_config.jerk_top_start_steps != top_start_steps) ||
+      (_config.jerk_top_steps != top_steps) ||
+      (_config.upm_jerk_bottom != upm_bottom)) {
+    _config.jerk_bottom_steps = bottom_steps;
+    _config.jerk_top_start_steps = top_start_steps;
+    _config.jerk_top_steps = top_steps;
+    _config.upm_jerk_bottom = upm_bottom;
+    _config.upm_jerk_inv_2top = upm_inv_2top;
+    _config.accel_change_cnt = _rw.accel_change_cnt + 1;
+  }
+}
+static inline bool is_jerk_limited(const struct ramp_config_s *config) {
+  return (config->jerk_bottom_steps | config->jerk_top_steps) != 0;
+}
+// true, if the ramp steps of both configs are the same
+static bool same_ramp_steps(const struct ramp_config_s *a,
+                            const struct ramp_config_s *b) {
+  return (a->upm_inv_accel2 == b->upm_inv_accel2) &&
+         (a->jerk_bottom_steps == b->jerk_bottom_steps) &&
+         (a->jerk_top_start_steps == b->jerk_top_start_steps) &&
+         (a->jerk_top_steps == b->jerk_top_steps);
+}
+// Map ramp steps r (r > 0) to the equivalent steps of the trapezoidal ramp
+static upm_float jerk_equivalent_steps(uint32_t r,
+                                       const struct ramp_config_s *config) {
+  uint32_t bottom_steps = config->jerk_bottom_steps;
+  if (r <= bottom_steps) {
+    upm_float upm_r = upm_from(r);
+    return upm_multiply(config->upm_jerk_bottom,
+                        upm_multiply(upm_r, upm_cbrt(upm_r)));
+  }
+  uint32_t p;
+  uint32_t top_start = config->jerk_top_start_steps;
+  if (r <= top_start) {
+    p = r - (bottom_steps >> 2);
+  } else {
+    uint32_t u = r - top_start;
+    uint32_t top_steps = config->jerk_top_steps;
+    p = top_start - (bottom_steps >> 2);
+    if (u < top_steps) {
+      p += u - upm_to_u32(upm_multiply(upm_square(upm_from(u)),
+                                       config->upm_jerk_inv_2top));
+    } else {
+      p += u - (top_steps >> 1);
+    }
+  }
+  return upm_from(p);
+}
+// Inverse of jerk_equivalent_steps()
+static uint32_t jerk_ramp_steps(upm_float upm_p,
+                                const struct ramp_config_s *config) {
+  uint32_t p = upm_to_u32(upm_p);
+  uint32_t bottom_steps = config->jerk_bottom_steps;
+  uint32_t bottom_offset = bottom_steps >> 2;
+  if (p < bottom_steps - bottom_offset) {
+    // r = (p/K_b)^(3/4) = x / sqrt(sqrt(x))
+    upm_float x = upm_divide(upm_p, config->upm_jerk_bottom);
+    return upm_to_u32(
+        upm_multiply(x, upm_rsqrt(upm_multiply(x, upm_rsqrt(x)))));
+  }
+  uint32_t top_start = config->jerk_top_start_steps;
+  uint32_t top_p = top_start - bottom_offset;
+  if (p <= top_p) {
+    return p + bottom_offset;
+  }
+  uint32_t top_steps = config->jerk_top_steps;
+  uint32_t dp = p - top_p;
+  if (dp < (top_steps >> 1)) {
+    // u = D - sqrt(D * (D - 2*dp))
+    upm_float upm_s = upm_multiply(upm_from(top_steps),
+                                   upm_from(top_steps - (dp << 1)));
+    uint32_t sqrt_s = upm_to_u32(upm_multiply(upm_s, upm_rsqrt(upm_s)));
+    if (sqrt_s > top_steps) {
+      sqrt_s = top_steps;
+    }
+    return top_start + top_steps - sqrt_s;
+  }
+  return top_start + dp + (top_steps >> 1);
+}
+// Calculate the ticks for given ramp steps
+static uint32_t calculate_ramp_ticks(uint32_t rs,
+                                     const struct ramp_config_s *config,
+                                     const RampTable *table) {
+  if (!is_jerk_limited(config)) {
+    if (table != NULL) {
+      uint32_t ticks = table->ticks(rs, config->upm_sqrt_inv_accel);
+      if (ticks != 0) {
+        return ticks;
+      }
+    }
+#if (FAS_RAMP_MATH_FIXED == 1)
+    return calculate_ticks_fixed(rs, config->sqrt_inv_accel_fixed);
+#else
+    return calculate_ticks_v8(rs, config->upm_sqrt_inv_accel);
+#endif
+  }
+  upm_float upm_p = jerk_equivalent_steps(rs, config);
+  return upm_to_u32(
+      upm_multiply(config->upm_sqrt_inv_accel, upm_rsqrt(upm_p)));
+}
+// Calculate the ramp steps for given ticks of a trapezoidal ramp
+static uint32_t calculate_ramp_steps(uint32_t ticks,
+                                     const struct ramp_config_s *config) {
+#if (FAS_RAMP_MATH_FIXED == 1)
+  return calculate_ramp_steps_fixed(ticks, config->sqrt_inv_accel_fixed);
+#else
+  return upm_to_u32(
+      upm_multiply(config->upm_inv_accel2, upm_rsquare(upm_from(ticks))));
+#endif
+}
+//*************************************************************************************************
 void RampGenerator::applySpeedAcceleration() {
   noInterrupts();
   _ro.config = _config;
   interrupts();
 }
 int8_t RampGenerator::startRun(bool countUp) {
+  return _startRun(countUp, 0);
+}
+int8_t RampGenerator::setTargetSpeed(int32_t speed_mhz) {
+  if (_config.min_travel_ticks == 0) {
+    return MOVE_ERR_SPEED_IS_UNDEFINED;
+  }
+  if (_config.upm_inv_accel2 == 0) {
+    return MOVE_ERR_ACCELERATION_IS_UNDEFINED;
+  }
+  bool count_up = (speed_mhz >= 0);
+  uint32_t abs_mhz = count_up ? speed_mhz : 0 - (uint32_t)speed_mhz;
+  // Speeds too low for 32 bit ticks are treated as standstill. The set speed
+  // is the upper limit.
+  uint32_t ticks = 0;
+  if (abs_mhz > (1000LL * TICKS_PER_S / 0xffffffff + 1)) {
+    ticks = max(divForMilliHz(abs_mhz), _config.min_travel_ticks);
+  }
+  noInterrupts();
+  if ((_rw.ramp_state != RAMP_STATE_IDLE) && _ro.keep_running) {
+    // Only the speed target is updated, the ramp continues with its config
+    if (ticks == 0) {
+      _ro.force_stop = true;
+    } else {
+      _ro.target_ticks = ticks;
+      _ro.keep_running_count_up = count_up;
+      _ro.force_stop = false;
+    }
+    interrupts();
+    return MOVE_OK;
+  }
+  interrupts();
+  if (ticks == 0) {
+    initiate_stop();
+    return MOVE_OK;
+  }
+  return _startRun(count_up, ticks);
+}
+int8_t RampGenerator::_startRun(bool countUp, uint32_t target_ticks) {
   if (_config.min_travel_ticks == 0) {
     return MOVE_ERR_SPEED_IS_UNDEFINED;
   }
@@ -109,13 +490,19 @@ int8_t RampGenerator::startRun(bool countUp) {
                                .target_pos = 0,
                                .force_stop = false,
                                .keep_running = true,
-                               .keep_running_count_up = countUp};
+                               .keep_running_count_up = countUp,
+                               .exit_ramp_steps = 0,
+                               .target_ticks = target_ticks};
 
   noInterrupts();
+  // a continuous run discards all queued segments
+  _seg_read_idx = _seg_write_idx;
+  _seg_active_junction = 0;
   if (_rw.ramp_state == RAMP_STATE_IDLE) {
     _rw.ramp_state = RAMP_STATE_ACCELERATE;
     _rw.curr_ticks = TICKS_FOR_STOPPED_MOTOR;
     _rw.performed_ramp_up_steps = 0;
+    _rw.ramp_steps_frac = 0;
   }
   _ro = new_ramp;
   interrupts();
@@ -134,14 +521,22 @@ int8_t RampGenerator::_startMove(int32_t target_pos, int32_t curr_target_pos) {
                                .target_pos = target_pos,
                                .force_stop = false,
                                .keep_running = false,
-                               .keep_running_count_up = true};
+                               .keep_running_count_up = true,
+                               .exit_ramp_steps = 0,
+                               .target_ticks = 0};
 
   noInterrupts();
+  // a new move discards all queued segments
+  _seg_read_idx = _seg_write_idx;
+  _seg_active_junction = 0;
+  _seg_last_target = target_pos;
+  _seg_last_count_up = target_pos > curr_target_pos;
   if ((_rw.ramp_state == RAMP_STATE_IDLE) && (target_pos != curr_target_pos)) {
     // Only start the ramp generator, if the target position is different
     _rw.ramp_state = RAMP_STATE_ACCELERATE;
     _rw.curr_ticks = TICKS_FOR_STOPPED_MOTOR;
     _rw.performed_ramp_up_steps = 0;
+    _rw.ramp_steps_frac = 0;
   }
   _ro = new_ramp;
   interrupts();
@@ -167,6 +562,11 @@ int8_t RampGenerator::moveTo(int32_t position,
   } else {
     curr_pos = queue_end->pos;
   }
+  uint32_t ticks = _jerkStartTicks(position, curr_pos);
+  if (ticks > speed_in_ticks) {
+    return moveToWithLimits(position, queue_end, ticks, acceleration,
+                            deceleration);
+  }
   inject_fill_interrupt(1);
   int res = _startMove(position, curr_pos);
   inject_fill_interrupt(2);
@@ -180,14 +580,466 @@ int8_t RampGenerator::move(int32_t move, const struct queue_end_s *queue_end) {
     curr_pos = queue_end->pos;
   }
   int32_t new_pos = curr_pos + move;
+  uint32_t ticks = _jerkStartTicks(new_pos, curr_pos);
+  if (ticks > speed_in_ticks) {
+    return moveToWithLimits(new_pos, queue_end, ticks, acceleration,
+                            deceleration);
+  }
   return _startMove(new_pos, curr_pos);
 }
+int8_t RampGenerator::moveToWithLimits(int32_t position,
+                                       const struct queue_end_s *queue_end,
+                                       uint32_t min_step_ticks, uint32_t accel,
+                                       uint32_t decel) {
+  uint32_t user_speed_in_ticks = speed_in_ticks;
+  uint32_t user_acceleration = acceleration;
+  uint32_t user_deceleration = deceleration;
+  struct ramp_config_s user_config = _config;
+  int8_t res = setSpeedInTicks(min_step_ticks);
+  if (res == 0) {
+    res = setAcceleration(accel);
+  }
+  if (res == 0) {
+    res = setDeceleration(decel);
+  }
+  if (res == 0) {
+    res = moveTo(position, queue_end);
+  }
+  // The running move keeps the limits in _ro.config. The config for the next
+  // move is restored, but with a new accel_change_cnt, so that the ramp is
+  // recalculated, if the next move is applied to the running ramp.
+  uint8_t accel_change_cnt = _config.accel_change_cnt;
+  speed_in_ticks = user_speed_in_ticks;
+  acceleration = user_acceleration;
+  deceleration = user_deceleration;
+  _config = user_config;
+  _config.accel_change_cnt = accel_change_cnt + 1;
+#if (FAS_RAMP_TABLE == 1)
+  // The temporary acceleration has rebuilt the table. Rebuild it for the
+  // restored config, otherwise later moves fall back to the upm math.
+  if (!_table.isValidFor(_config.upm_sqrt_inv_accel)) {
+    _table.build(_config.upm_sqrt_inv_accel);
+  }
+#endif
+  return res;
+}
+
+//*************************************************************************************************
+// Move in given time
+//
+// As derived in doc/ramp.md, a move with acceleration a, deceleration d and
+// speed v performs in total time T:
+//
+//     steps = v * T - v² / 2 * (1/a + 1/d)
+//
+// With k = (1/a + 1/d) / 2 the slowest speed to finish in time T is:
+//
+//         T - sqrt(T² - 4 * k * steps)          2 * steps
+//     v = ---------------------------- = -------------------------
+//                   2 * k                T + sqrt(T² - 4*k*steps)
+//
+// For a = d this is v = a * Ta with Ta being the acceleration time.
+//
+//*************************************************************************************************
+int8_t RampGenerator::moveToInTime(int32_t position, uint32_t duration_ms,
+                                   const struct queue_end_s *queue_end) {
+  if (_config.min_travel_ticks == 0) {
+    return MOVE_ERR_SPEED_IS_UNDEFINED;
+  }
+  if (_config.upm_inv_accel2 == 0) {
+    return MOVE_ERR_ACCELERATION_IS_UNDEFINED;
+  }
+  int32_t curr_pos;
+  if (isRampGeneratorActive() && !_ro.keep_running) {
+    curr_pos = _ro.target_pos;
+  } else {
+    curr_pos = queue_end->pos;
+  }
+  int32_t delta = position - curr_pos;
+  uint32_t steps = (delta < 0) ? -delta : delta;
+  if (steps == 0) {
+    return moveTo(position, queue_end);
+  }
+
+  // T in units of 2^shift ms, so that T² fits into uint32_t
+  uint8_t shift = 0;
+  uint32_t t = duration_ms;
+  while (t > 65535) {
+    t >>= 1;
+    shift++;
+  }
+  // 4 * k * steps = 2 * steps * (a + d) / (a * d) in s² => * 10^6 for ms²
+  uint32_t decel = getDeceleration();
+  upm_float upm_ks = upm_divide(
+      upm_multiply(upm_from(steps), upm_from(acceleration + decel)),
+      upm_multiply(upm_from(acceleration), upm_from(decel)));
+  upm_ks = upm_multiply(upm_ks, upm_multiply(UPM_CONST_1000, UPM_CONST_2000));
+  uint32_t ks = upm_to_u32(upm_shr(upm_ks, 2 * shift));
+  uint32_t t2 = t * t;
+  if (ks >= t2) {
+    // even a triangle ramp with max. acceleration is too slow
+    return MOVE_ERR_DURATION_TOO_SHORT;
+  }
+  uint32_t root = 0;
+  if (t2 - ks > 0) {
+    upm_float upm_diff = upm_from(t2 - ks);
+    root = upm_to_u32(upm_multiply(upm_diff, upm_rsqrt(upm_diff)));
+  }
+  // ticks per step = TICKS_PER_S / v = TICKS_PER_S * (T + root) / (2*steps)
+  upm_float upm_ticks = upm_divide(
+      upm_multiply(UPM_TICKS_PER_S, upm_shl(upm_from(t + root), shift)),
+      upm_multiply(upm_from(steps), UPM_CONST_2000));
+  uint32_t ticks = upm_to_u32(upm_ticks);
+  if (ticks < speed_in_ticks) {
+    // required speed exceeds the max. speed
+    return MOVE_ERR_DURATION_TOO_SHORT;
+  }
+  if (ticks == TICKS_FOR_STOPPED_MOTOR) {
+    ticks--;
+  }
+  return moveToWithLimits(position, queue_end, ticks, acceleration,
+                          deceleration);
+}
+int8_t RampGenerator::moveInTime(int32_t move, uint32_t duration_ms,
+                                 const struct queue_end_s *queue_end) {
+  int32_t curr_pos;
+  if (isRampGeneratorActive() && !_ro.keep_running) {
+    curr_pos = _ro.target_pos;
+  } else {
+    curr_pos = queue_end->pos;
+  }
+  return moveToInTime(curr_pos + move, duration_ms, queue_end);
+}
+
+//*************************************************************************************************
+// Segment queue
+//
+// Each segment stores the speed at time of queueMoveTo(). The acceleration
+// and jerk are stored once in _seg_config for all queued segments, so a
+// change of those is rejected while segments are queued. If the direction
+// of two consecutive segments is the same, then the ramp steps at the
+// junction are limited by the lower speed of both segments
+// (junction_ramp_steps). The ramp steps at the end of a segment must allow
+// to decelerate over all following segments (exit_ramp_steps), which is
+// calculated backwards from the last segment.
+//
+// _getNextCommand() adds exit_ramp_steps to the remaining steps. So the ramp
+// decelerates towards the end of the last blended segment and is at most at
+// junction speed, when target_pos is passed.
+//*************************************************************************************************
+int8_t RampGenerator::queueMoveTo(int32_t position,
+                                  const struct queue_end_s *queue_end) {
+  if (!isRampGeneratorActive() || _ro.force_stop || _ro.keep_running) {
+    return moveTo(position, queue_end);
+  }
+  if (_config.min_travel_ticks == 0) {
+    return MOVE_ERR_SPEED_IS_UNDEFINED;
+  }
+  if (_config.upm_inv_accel2 == 0) {
+    return MOVE_ERR_ACCELERATION_IS_UNDEFINED;
+  }
+  noInterrupts();
+  uint8_t rp = _seg_read_idx;
+  uint8_t wp = _seg_write_idx;
+  interrupts();
+  if ((uint8_t)(wp - rp) >= RAMP_SEGMENT_QUEUE_LEN) {
+    return MOVE_ERR_SEGMENT_QUEUE_FULL;
+  }
+  int32_t delta = position - _seg_last_target;
+  if (delta == 0) {
+    return MOVE_OK;
+  }
+  bool count_up = delta > 0;
+
+  // The previous segment is not modified by getNextCommand()
+  const struct ramp_config_s *prev;
+  uint32_t prev_ticks;
+  if (wp == rp) {
+    prev = &_ro.config;
+    prev_ticks = _ro.config.min_travel_ticks;
+    _seg_config = _config;
+  } else {
+    prev = &_seg_config;
+    prev_ticks = _segments[(uint8_t)(wp - 1) & RAMP_SEGMENT_QUEUE_MASK]
+                     .min_travel_ticks;
+    if (!same_ramp_steps(&_config, &_seg_config) ||
+        (_config.accel_ramp_factor != _seg_config.accel_ramp_factor)) {
+      return MOVE_ERR_SEGMENT_ACCELERATION_CHANGED;
+    }
+  }
+  uint32_t junction = 0;
+  if ((count_up == _seg_last_count_up) && !is_jerk_limited(prev) &&
+      !is_jerk_limited(&_config)) {
+    uint32_t ticks = max(prev_ticks, _config.min_travel_ticks);
+    junction = calculate_ramp_steps(ticks, prev);
+    // Add a margin for the upm precision. Better to decelerate further after
+    // the junction than to accelerate again
+    junction += junction >> 6;
+  }
+
+  struct ramp_segment_s *seg = &_segments[wp & RAMP_SEGMENT_QUEUE_MASK];
+  seg->min_travel_ticks = _config.min_travel_ticks;
+  seg->target_pos = position;
+  seg->steps = abs(delta);
+  seg->junction_ramp_steps = 0;
+  seg->exit_ramp_steps = 0;
+  _seg_last_target = position;
+  _seg_last_count_up = count_up;
+
+  noInterrupts();
+  if (_rw.ramp_state == RAMP_STATE_IDLE) {
+    // ramp has been completed meanwhile
+    interrupts();
+    return moveTo(position, queue_end);
+  }
+  if (_seg_read_idx == wp) {
+    // queue is empty, either before or due to segment switch meanwhile
+    _seg_active_junction = junction;
+  } else {
+    _segments[(uint8_t)(wp - 1) & RAMP_SEGMENT_QUEUE_MASK]
+        .junction_ramp_steps = junction;
+  }
+  _seg_write_idx = wp + 1;
+  _updateExitRampSteps();
+  interrupts();
+  return MOVE_OK;
+}
+int8_t RampGenerator::queueMove(int32_t move,
+                                const struct queue_end_s *queue_end) {
+  if (!isRampGeneratorActive() || _ro.force_stop || _ro.keep_running) {
+    return this->move(move, queue_end);
+  }
+  return queueMoveTo(_seg_last_target + move, queue_end);
+}
+// Must be called with interrupts disabled
+void RampGenerator::_updateExitRampSteps() {
+  uint32_t following = 0;
+  uint8_t idx = _seg_write_idx;
+  uint8_t rp = _seg_read_idx;
+  while (idx != rp) {
+    idx--;
+    struct ramp_segment_s *seg = &_segments[idx & RAMP_SEGMENT_QUEUE_MASK];
+    seg->exit_ramp_steps = min(seg->junction_ramp_steps, following);
+    following = seg->steps + seg->exit_ramp_steps;
+  }
+  _ro.exit_ramp_steps = min(_seg_active_junction, following);
+}
+// Called with interrupts disabled before the ramp is copied
+void RampGenerator::_advanceSegment(const struct queue_end_s *queue_end) {
+  while (_seg_read_idx != _seg_write_idx) {
+    if (_ro.force_stop || _ro.keep_running) {
+      return;
+    }
+    int32_t delta = _ro.target_pos - queue_end->pos;
+    if (delta != 0) {
+      if (_ro.exit_ramp_steps == 0) {
+        // target not yet reached
+        return;
+      }
+      // on blending the target can be passed
+      if ((delta > 0) == queue_end->count_up) {
+        return;
+      }
+    }
+    struct ramp_segment_s *seg =
+        &_segments[_seg_read_idx & RAMP_SEGMENT_QUEUE_MASK];
+    // performed_ramp_up_steps needs only to be recalculated on config change
+    uint8_t accel_change_cnt = _rw.accel_change_cnt;
+    if (!same_ramp_steps(&_seg_config, &_ro.config)) {
+      accel_change_cnt++;
+    }
+    _ro.config = _seg_config;
+    _ro.config.min_travel_ticks = seg->min_travel_ticks;
+    _ro.config.accel_change_cnt = accel_change_cnt;
+    _ro.target_pos = seg->target_pos;
+    _ro.exit_ramp_steps = seg->exit_ramp_steps;
+    _seg_active_junction = seg->junction_ramp_steps;
+    _seg_read_idx++;
+  }
+}
+
+//*************************************************************************************************
+// Remaining time
+//
+// Starting from standstill, a ramp with deceleration d reaches r ramp steps
+// after (in ticks):
+//
+//     t(r) = v/d = sqrt(2*r/d) = 2 * sqrt(r) * sqrt_inv_accel
+//
+// The time between two ramp step values is the difference of t(), which
+// is divided by a/d for acceleration. On acceleration one step increases the
+// ramp steps by a/d. So with r0 ramp steps at start, e ramp steps at the end
+// and s steps to go, the ramp steps at the peak are:
+//
+//     r_p = r0 + (s + e - r0) * a/(a+d)
+//
+// If r_p exceeds the ramp steps at max speed, then the excess is coasting.
+// Jerk limited ramps are approximated by the trapezoidal ramp.
+//*************************************************************************************************
+static uint32_t ticks_to_us(upm_float upm_ticks) {
+  return upm_to_u32(
+      upm_divide(upm_ticks, upm_from((uint32_t)(TICKS_PER_S / 1000000L))));
+}
+static uint32_t add_saturated(uint32_t a, uint32_t b) {
+  uint32_t res = a + b;
+  return (res < a) ? 0xffffffff : res;
+}
+// upm rounding can make t() slightly non-monotonic
+static uint32_t sub_clamped(uint32_t a, uint32_t b) {
+  return (a > b) ? a - b : 0;
+}
+// t(rs) in us
+static uint32_t ramp_up_time_in_us(uint32_t rs,
+                                   const struct ramp_config_s *config) {
+  if (rs == 0) {
+    return 0;
+  }
+  upm_float upm_rs = upm_from(rs);
+  // sqrt(rs) = rs / sqrt(rs)
+  upm_float upm_sqrt_rs = upm_multiply(upm_rs, upm_rsqrt(upm_rs));
+  return ticks_to_us(
+      upm_shl(upm_multiply(upm_sqrt_rs, config->upm_sqrt_inv_accel), 1));
+}
+// Convert time or ramp steps of the deceleration to those of the acceleration
+static uint32_t div_accel_ramp_factor(uint32_t x,
+                                      const struct ramp_config_s *config) {
+  if (config->accel_ramp_factor == 0x10000) {
+    return x;
+  }
+  return upm_to_u32(upm_divide(upm_shl(upm_from(x), 16),
+                               upm_from(config->accel_ramp_factor)));
+}
+// Time in us for s steps with r0 ramp steps at start. *e is the requested
+// ramp steps at the end and is updated to the reached ramp steps.
+static uint32_t ramp_time_in_us(uint32_t s, uint32_t r0, uint32_t *e,
+                                const struct ramp_config_s *config) {
+  uint32_t t0 = ramp_up_time_in_us(r0, config);
+  // The ramp generator tolerates one excess ramp step on stop
+  if ((s < r0) && (r0 - s > *e + 1)) {
+    if (*e != 0) {
+      // passes the target faster than requested
+      *e = r0 - s;
+      return sub_clamped(t0, ramp_up_time_in_us(r0 - s, config));
+    }
+    // stops behind the target and returns from standstill
+    return add_saturated(t0, ramp_time_in_us(r0 - s, 0, e, config));
+  }
+  uint32_t r_max = calculate_ramp_steps(config->min_travel_ticks, config);
+  *e = min(*e, r_max);
+  uint32_t coast_steps;
+  uint32_t t;
+  if (r0 >= r_max) {
+    // decelerate to max speed, coast and decelerate to e
+    coast_steps = sub_clamped(s + *e, r0);
+    t = sub_clamped(t0, ramp_up_time_in_us(*e, config));
+  } else {
+    uint32_t rest = sub_clamped(s + *e, r0);
+    uint32_t dec;
+    if (config->upm_accel_plan_factor == 0) {
+      dec = rest >> 1;
+    } else {
+      dec = upm_to_u32(
+          upm_multiply(upm_from(rest), config->upm_accel_plan_factor));
+    }
+    uint32_t r_p = r0 + rest - dec;
+    if (r_p < *e) {
+      // too few steps to reach e: accelerate all the way
+      uint32_t r_end = s;
+      if (config->accel_ramp_factor != 0x10000) {
+        r_end = upm_to_u32(upm_shr(
+            upm_multiply(upm_from(s), upm_from(config->accel_ramp_factor)),
+            16));
+      }
+      *e = min(r0 + r_end, *e);
+      return div_accel_ramp_factor(
+          sub_clamped(ramp_up_time_in_us(*e, config), t0), config);
+    }
+    if (r_p <= r_max) {
+      uint32_t tp = ramp_up_time_in_us(r_p, config);
+      uint32_t te = ramp_up_time_in_us(*e, config);
+      return add_saturated(div_accel_ramp_factor(sub_clamped(tp, t0), config),
+                           sub_clamped(tp, te));
+    }
+    uint32_t t_max = ramp_up_time_in_us(r_max, config);
+    uint32_t te = ramp_up_time_in_us(*e, config);
+    uint32_t ramp_steps =
+        add_saturated(div_accel_ramp_factor(r_max - r0, config), r_max - *e);
+    coast_steps = sub_clamped(s, ramp_steps);
+    t = add_saturated(div_accel_ramp_factor(sub_clamped(t_max, t0), config),
+                      sub_clamped(t_max, te));
+  }
+  uint32_t t_coast = ticks_to_us(
+      upm_multiply(upm_from(coast_steps), upm_from(config->min_travel_ticks)));
+  return add_saturated(t, t_coast);
+}
+uint32_t RampGenerator::getRemainingTimeInUs(
+    const struct queue_end_s *queue_end) {
+  noInterrupts();
+  uint8_t state = _rw.ramp_state;
+  uint32_t r0 = _rw.performed_ramp_up_steps;
+  uint32_t curr_ticks = _rw.curr_ticks;
+  bool recalc = (_rw.accel_change_cnt != _ro.config.accel_change_cnt);
+  struct ramp_ro_s ro = _ro;
+  struct queue_end_s qe = *queue_end;
+  uint8_t rp = _seg_read_idx;
+  uint8_t wp = _seg_write_idx;
+  interrupts();
+  if (state == RAMP_STATE_IDLE) {
+    return 0;
+  }
+  if (curr_ticks == TICKS_FOR_STOPPED_MOTOR) {
+    r0 = 0;
+  } else if (recalc && !is_jerk_limited(&ro.config)) {
+    // the ramp generator has not yet picked up the new acceleration
+    r0 = calculate_ramp_steps(curr_ticks, &ro.config);
+  }
+  if (ro.force_stop) {
+    return ramp_up_time_in_us(r0, &ro.config);
+  }
+  if (ro.keep_running) {
+    return 0xffffffff;
+  }
+  int32_t delta = ro.target_pos - qe.pos;
+  uint32_t steps = abs(delta);
+  uint32_t e = ro.exit_ramp_steps;
+  // steps of the next segment already performed
+  uint32_t overrun = 0;
+  uint32_t t;
+  if ((r0 != 0) && (delta != 0) && ((delta > 0) != qe.count_up)) {
+    if (e != 0) {
+      // target passed on blending into the next segment
+      overrun = steps;
+      e = r0;
+      t = 0;
+    } else {
+      // moving away from the target: stop and return from standstill
+      t = add_saturated(ramp_up_time_in_us(r0, &ro.config),
+                        ramp_time_in_us(steps + r0, 0, &e, &ro.config));
+    }
+  } else {
+    t = ramp_time_in_us(steps, r0, &e, &ro.config);
+  }
+  // Segments not yet started are only modified by the application
+  struct ramp_config_s config = _seg_config;
+  while (rp != wp) {
+    const struct ramp_segment_s *seg =
+        &_segments[rp++ & RAMP_SEGMENT_QUEUE_MASK];
+    uint32_t r = e;
+    e = seg->exit_ramp_steps;
+    config.min_travel_ticks = seg->min_travel_ticks;
+    t = add_saturated(t, ramp_time_in_us(sub_clamped(seg->steps, overrun), r,
+                                         &e, &config));
+    overrun = 0;
+  }
+  return t;
+}
 
 //*************************************************************************************************
 static void _getNextCommand(const struct ramp_ro_s *ramp,
                             const struct ramp_rw_s *rw,
                             const struct queue_end_s *queue_end,
-                            NextCommand *command) {
+                            const RampTable *table, uint32_t cmd_ticks,
+                            upm_float upm_cmd_ticks, NextCommand *command) {
   {
     // If there is a pause from last step, then just output a pause
     uint32_t pause_ticks = rw->pause_ticks_left;
@@ -216,12 +1068,19 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
   uint32_t curr_ticks = rw->curr_ticks;
   uint8_t accel_change_cnt = ramp->config.accel_change_cnt;
   uint32_t performed_ramp_up_steps;
+  uint16_t ramp_steps_frac = 0;
   if (accel_change_cnt != rw->accel_change_cnt) {
     if (curr_ticks == TICKS_FOR_STOPPED_MOTOR) {
       performed_ramp_up_steps = 0;
     } else {
-      performed_ramp_up_steps = upm_to_u32(upm_multiply(
-          ramp->config.upm_inv_accel2, upm_rsquare(upm_from(curr_ticks))));
+      if (is_jerk_limited(&ramp->config)) {
+        upm_float upm_p = upm_multiply(ramp->config.upm_inv_accel2,
+                                       upm_rsquare(upm_from(curr_ticks)));
+        performed_ramp_up_steps = jerk_ramp_steps(upm_p, &ramp->config);
+      } else {
+        performed_ramp_up_steps =
+            calculate_ramp_steps(curr_ticks, &ramp->config);
+      }
 #ifdef TEST
       printf("Recalculate performed_ramp_up_steps to %d from %d ticks\n",
              performed_ramp_up_steps, curr_ticks);
@@ -229,6 +1088,7 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
     }
   } else {
     performed_ramp_up_steps = rw->performed_ramp_up_steps;
+    ramp_steps_frac = rw->ramp_steps_frac;
   }
 
   bool count_up = queue_end->count_up;
@@ -237,9 +1097,12 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
   uint8_t this_state;
   uint32_t remaining_steps;
   bool need_count_up;
+  uint32_t travel_ticks = ramp->config.min_travel_ticks;
   if (ramp->keep_running) {
     need_count_up = ramp->keep_running_count_up;
     remaining_steps = 0xfffffff;
+    // the set speed is the limit also after applySpeedAcceleration()
+    travel_ticks = max(travel_ticks, ramp->target_ticks);
   } else {
     // this can overflow, which is legal
     int32_t delta = ramp->target_pos - queue_end->pos;
@@ -251,6 +1114,10 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
       need_count_up = delta > 0;
     }
     remaining_steps = abs(delta);
+    if (delta != 0) {
+      // blend into the next segment
+      remaining_steps += ramp->exit_ramp_steps;
+    }
   }
 
   // If not moving, then use requested direction
@@ -269,11 +1136,10 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
     return;
   }
 
-  // Forward planning of 2ms or more on slow speed.
+  // Forward planning of cmd_ticks or more on slow speed.
   uint16_t planning_steps;
-  if (curr_ticks < TICKS_PER_S / 1000) {
-    upm_float upm_ps =
-        upm_divide(UPM_TICKS_PER_S_DIV_500, upm_from(curr_ticks));
+  if (curr_ticks < cmd_ticks / 2) {
+    upm_float upm_ps = upm_divide(upm_cmd_ticks, upm_from(curr_ticks));
     planning_steps = upm_to_u16(upm_ps);
   } else {
     planning_steps = 1;
@@ -281,6 +1147,7 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
 
   // In case of force stop just run down the ramp
   uint32_t coast_speed = rw->curr_ticks;
+  bool decelerate_to_speed = false;
   if (ramp->force_stop) {
     this_state = RAMP_STATE_DECELERATE_TO_STOP;
     remaining_steps = performed_ramp_up_steps;
@@ -297,7 +1164,7 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
       // We will overshoot
       this_state = RAMP_STATE_REVERSE;
       remaining_steps = performed_ramp_up_steps;
-    } else if (ramp->config.min_travel_ticks < rw->curr_ticks) {
+    } else if (travel_ticks < rw->curr_ticks) {
       this_state = RAMP_STATE_ACCELERATE;
       if (rw->curr_ticks < 2 * MIN_CMD_TICKS) {
         // special consideration needed, that invalid commands are not generated
@@ -323,10 +1190,21 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
         if (curr_ticks != TICKS_FOR_STOPPED_MOTOR) {
           this_state = RAMP_STATE_COAST;
           planning_steps = remaining_steps - performed_ramp_up_steps;
+          // If the top of the remaining triangle reaches the travel speed,
+          // then coast at travel speed. Otherwise an exact tick calculation
+          // ends a few ticks short of travel speed due to the planning
+          // granularity.
+          uint32_t top_steps =
+              performed_ramp_up_steps + ((uint32_t)planning_steps >> 1);
+          if (calculate_ramp_ticks(top_steps, &ramp->config, table) <=
+              travel_ticks) {
+            coast_speed = travel_ticks;
+          }
         }
       }
-    } else if (ramp->config.min_travel_ticks > rw->curr_ticks) {
+    } else if (travel_ticks > rw->curr_ticks) {
       this_state = RAMP_STATE_DECELERATE;
+      decelerate_to_speed = true;
       if (performed_ramp_up_steps <= planning_steps) {
         if (performed_ramp_up_steps > 0) {
           planning_steps = performed_ramp_up_steps;
@@ -336,7 +1214,7 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
       }
     } else {
       this_state = RAMP_STATE_COAST;
-      coast_speed = ramp->config.min_travel_ticks;
+      coast_speed = travel_ticks;
     }
   }
   if (remaining_steps == 0) {  // This implies performed_ramp_up_steps == 0
@@ -373,20 +1251,31 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
   {
     uint32_t coast_steps;
     if (this_state & RAMP_STATE_ACCELERATING_FLAG) {
-      // do not overshoot ramp down start
-      planning_steps =
-          min(planning_steps, (remaining_steps - performed_ramp_up_steps) >> 1);
+      // do not overshoot ramp down start. The gap is reduced by the
+      // remaining steps and the ramp steps. So with a == d by half
+      uint32_t gap = remaining_steps - performed_ramp_up_steps;
+      if (ramp->config.upm_accel_plan_factor == 0) {
+        gap >>= 1;
+      } else {
+        gap = upm_to_u32(
+            upm_multiply(upm_from(gap), ramp->config.upm_accel_plan_factor));
+      }
+      planning_steps = min(planning_steps, gap);
 
-      uint32_t rs = performed_ramp_up_steps + planning_steps;
-      d_ticks_new = calculate_ticks_v8(rs, ramp->config.upm_sqrt_inv_accel);
+      // planning_steps can exceed 255, so reduce the factor's precision
+      uint32_t rs =
+          performed_ramp_up_steps +
+          (((uint32_t)planning_steps * (ramp->config.accel_ramp_factor >> 8)) >>
+           8);
+      d_ticks_new = calculate_ramp_ticks(rs, &ramp->config, table);
 #ifdef TEST
       printf("Calculate d_ticks_new=%d from ramp steps=%d\n", d_ticks_new, rs);
 #endif
 
       // if acceleration is very high, then d_ticks_new can be lower than
       // min_travel_ticks
-      if (d_ticks_new < ramp->config.min_travel_ticks) {
-        d_ticks_new = ramp->config.min_travel_ticks;
+      if (d_ticks_new < travel_ticks) {
+        d_ticks_new = travel_ticks;
       }
     } else if (this_state & RAMP_STATE_DECELERATING_FLAG) {
       uint32_t rs;
@@ -395,10 +1284,16 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
       } else {
         rs = performed_ramp_up_steps - planning_steps;
       }
-      d_ticks_new = calculate_ticks_v8(rs, ramp->config.upm_sqrt_inv_accel);
+      d_ticks_new = calculate_ramp_ticks(rs, &ramp->config, table);
 #ifdef TEST
       printf("Calculate d_ticks_new=%d from ramp steps=%d\n", d_ticks_new, rs);
 #endif
+
+      // on deceleration to lower speed, do not overshoot the new speed
+      if (decelerate_to_speed &&
+          (d_ticks_new > travel_ticks)) {
+        d_ticks_new = travel_ticks;
+      }
     } else {
       d_ticks_new = coast_speed;
       // do not overshoot ramp down start
@@ -464,7 +1359,12 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
   uint16_t steps = planning_steps;
   steps = min(steps, abs(remaining_steps));  // This could be problematic
   steps = max(steps, 1);
-  steps = min(255, steps);
+  if (this_state & RAMP_STATE_ACCELERATING_FLAG) {
+    // steps * accel_ramp_factor must not overflow
+    steps = min(255, steps);
+  } else {
+    steps = min(MAX_CMD_STEPS, steps);
+  }
 
   // Check if pauses need to be added. If yes, reduce next_ticks and calculate
   // pause_ticks_left
@@ -481,7 +1381,10 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
 
   // determine performed_ramp_up_steps after command enqueued
   if (this_state & RAMP_STATE_ACCELERATING_FLAG) {
-    performed_ramp_up_steps += steps;
+    uint32_t delta =
+        (uint32_t)steps * ramp->config.accel_ramp_factor + ramp_steps_frac;
+    performed_ramp_up_steps += delta >> 16;
+    ramp_steps_frac = delta & 0xffff;
   } else if (this_state & RAMP_STATE_DECELERATING_FLAG) {
     if (performed_ramp_up_steps < steps) {
       // This can occur with performed_ramp_up_steps = 0 and steps = 1
@@ -490,6 +1393,7 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
 #endif
       // based on above assumption actually obsolete
       performed_ramp_up_steps = 0;
+      ramp_steps_frac = 0;
     } else {
       performed_ramp_up_steps -= steps;
     }
@@ -508,6 +1412,7 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
   command->rw.ramp_state = this_state;
   command->rw.accel_change_cnt = accel_change_cnt;
   command->rw.performed_ramp_up_steps = performed_ramp_up_steps;
+  command->rw.ramp_steps_frac = ramp_steps_frac;
   command->rw.pause_ticks_left = pause_ticks_left;
   command->rw.curr_ticks = pause_ticks_left + next_ticks;
 
@@ -516,7 +1421,7 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
       "pos@queue_end=%d remaining=%u ramp steps=%u planning steps=%d "
       "last_ticks=%u travel_ticks=%u ",
       queue_end->pos, remaining_steps, performed_ramp_up_steps, planning_steps,
-      rw->curr_ticks, ramp->config.min_travel_ticks);
+      rw->curr_ticks, travel_ticks);
   switch (this_state & RAMP_DIRECTION_MASK) {
     case RAMP_DIRECTION_COUNT_UP:
       printf("+");
@@ -550,7 +1455,7 @@ static void _getNextCommand(const struct ramp_ro_s *ramp,
       steps, next_ticks, ramp->target_pos, remaining_steps, planning_steps,
       d_ticks_new, pause_ticks_left);
   if ((this_state & RAMP_STATE_MASK) == RAMP_STATE_ACCELERATE) {
-    assert(pause_ticks_left + next_ticks >= ramp->config.min_travel_ticks);
+    assert(pause_ticks_left + next_ticks >= travel_ticks);
   }
 #endif
 }
@@ -567,17 +1472,26 @@ void RampGenerator::afterCommandEnqueued(NextCommand *command) {
 void RampGenerator::getNextCommand(const struct queue_end_s *queue_end,
                                    NextCommand *command) {
   noInterrupts();
+  _advanceSegment(queue_end);
   // copy consistent ramp state
   struct ramp_ro_s ramp = _ro;
   interrupts();
 
-  return _getNextCommand(&ramp, &_rw, queue_end, command);
+  const RampTable *table = NULL;
+#if (FAS_RAMP_TABLE == 1)
+  if (_table.isValidFor(ramp.config.upm_sqrt_inv_accel)) {
+    table = &_table;
+  }
+#endif
+  return _getNextCommand(&ramp, &_rw, queue_end, table, _cmd_ticks,
+                         _upm_cmd_ticks, command);
 }
 void RampGenerator::stopRamp() {
   // Should be safe on avr and on esp32 due to task prio
   _rw.ramp_state = RAMP_STATE_IDLE;
   _rw.curr_ticks = TICKS_FOR_STOPPED_MOTOR;
   _rw.performed_ramp_up_steps = 0;
+  _rw.ramp_steps_frac = 0;
 }
 bool RampGenerator::isRampGeneratorActive() {
   return (_rw.ramp_state != RAMP_STATE_IDLE);
@@ -589,11 +1503,11 @@ int32_t RampGenerator::getCurrentAcceleration() {
     case RAMP_STATE_ACCELERATING_FLAG | RAMP_DIRECTION_COUNT_UP:
       return acceleration;
     case RAMP_STATE_DECELERATING_FLAG | RAMP_DIRECTION_COUNT_UP:
-      return -acceleration;
+      return -getDeceleration();
     case RAMP_STATE_ACCELERATING_FLAG | RAMP_DIRECTION_COUNT_DOWN:
       return -acceleration;
     case RAMP_STATE_DECELERATING_FLAG | RAMP_DIRECTION_COUNT_DOWN:
-      return acceleration;
+      return getDeceleration();
   }
   return 0;
 }
@@ -19,20 +19,38 @@
 #define TICKS_PER_S 16000000L
 #endif
 
+#include "RampCalculator.h"
 #include "common.h"
 
+// The ramp table trades RAM (RAMP_TABLE_SIZE*2 bytes per stepper) for a faster
+// ramp calculation in the fill queue task/interrupt. Enable it by build flag:
+//	-DFAS_RAMP_TABLE=1
+#ifndef FAS_RAMP_TABLE
+#define FAS_RAMP_TABLE 0
+#endif
+
+// Ramp math backend for the conversion between ramp steps and ticks.
+// The upm_float based calculation is best for avr. 32 bit targets use
+// fixed point with better precision. Can be overridden by build flag:
+//	-DFAS_RAMP_MATH_FIXED=0 or -DFAS_RAMP_MATH_FIXED=1
+#ifndef FAS_RAMP_MATH_FIXED
+#if defined(ARDUINO_ARCH_ESP32)
+#define FAS_RAMP_MATH_FIXED 1
+#else
+#define FAS_RAMP_MATH_FIXED 0
+#endif
+#endif
+
 class FastAccelStepper;
 
 #if (TICKS_PER_S == 16000000L)
 #define UPM_TICKS_PER_S UPM_CONST_16E6
-#define UPM_TICKS_PER_S_DIV_500 UPM_CONST_32000
 #define UPM_TICKS_PER_S_DIV_SQRT_OF_2 UPM_CONST_16E6_DIV_SQRT_OF_2
 #define UPM_ACCEL_FACTOR UPM_CONST_128E12
 #define US_TO_TICKS(u32) (u32 * 16)
 #define TICKS_TO_US(u32) (u32 / 16)
 #else
 #define UPM_TICKS_PER_S upm_timer_freq
-#define UPM_TICKS_PER_S_DIV_500 upm_timer_freq_div_500
 
 // This overflows for approx. 1s at 40 MHz, only
 #define US_TO_TICKS(u32) \
@@ -45,9 +63,29 @@ class FastAccelStepper;
 
 struct ramp_config_s {
   uint32_t min_travel_ticks;
+  // upm_inv_accel2 and upm_sqrt_inv_accel are calculated from deceleration
   upm_float upm_inv_accel2;
   upm_float upm_sqrt_inv_accel;
+#if (FAS_RAMP_MATH_FIXED == 1)
+  // TICKS_PER_S/sqrt(2*d) in 24.8 fixed point
+  uint32_t sqrt_inv_accel_fixed;
+#endif
   uint8_t accel_change_cnt;
+  // With deceleration != acceleration, one step on acceleration changes the
+  // ramp steps by a/d. accel_ramp_factor is a/d in 16.16 fixed point (65536
+  // for a == d). upm_accel_plan_factor is d/(a+d) and 0 for a == d
+  uint32_t accel_ramp_factor;
+  upm_float upm_accel_plan_factor;
+  // jerk limited ramp (S-curve). All values are zero for trapezoidal ramp.
+  // The ramp steps are mapped to the equivalent steps of a trapezoidal ramp
+  // in three regions: jerk phase from/to standstill (jerk_bottom_steps),
+  // constant acceleration and jerk phase from/to coasting
+  // (jerk_top_start_steps...jerk_top_start_steps+jerk_top_steps)
+  uint32_t jerk_bottom_steps;
+  uint32_t jerk_top_start_steps;
+  uint32_t jerk_top_steps;
+  upm_float upm_jerk_bottom;
+  upm_float upm_jerk_inv_2top;
 };
 struct ramp_ro_s {
   struct ramp_config_s config;
@@ -55,6 +93,37 @@ struct ramp_ro_s {
   bool force_stop;
   bool keep_running;
   bool keep_running_count_up;
+  // ramp steps at target_pos for blending into the next queued segment.
+  // 0 means to come to standstill at target_pos
+  uint32_t exit_ramp_steps;
+  // speed for keep_running set by setTargetSpeed(). 0 means to run with
+  // config.min_travel_ticks
+  uint32_t target_ticks;
+};
+
+// Queue of move segments, which are consumed by the ramp generator one after
+// the other. Consecutive segments in same direction are blended without
+// stopping at the intermediate target. Needs to be a power of 2.
+#ifndef RAMP_SEGMENT_QUEUE_LEN
+#if defined(ARDUINO_ARCH_AVR)
+#define RAMP_SEGMENT_QUEUE_LEN 4
+#else
+#define RAMP_SEGMENT_QUEUE_LEN 8
+#endif
+#endif
+#define RAMP_SEGMENT_QUEUE_MASK (RAMP_SEGMENT_QUEUE_LEN - 1)
+
+// Only the speed is stored per segment. All queued segments share the
+// acceleration/jerk of _seg_config to save RAM.
+struct ramp_segment_s {
+  uint32_t min_travel_ticks;
+  int32_t target_pos;
+  uint32_t steps;
+  // max. ramp steps at target_pos for the transition into the next segment.
+  // 0 for direction change or if there is no next segment
+  uint32_t junction_ramp_steps;
+  // ramp steps at target_pos considering all following segments
+  uint32_t exit_ramp_steps;
 };
 
 struct ramp_rw_s {
@@ -63,8 +132,13 @@ struct ramp_rw_s {
   // performed_ramp_up_steps to be recalculated
   uint8_t accel_change_cnt;
   // the speed is linked on both ramp slopes to this variable as per
-  //       s = v²/2a   =>   v = sqrt(2*a*s)
+  //       s = v²/2d   =>   v = sqrt(2*d*s)
+  // with d being the deceleration. So this is the number of steps needed
+  // to come to standstill.
   uint32_t performed_ramp_up_steps;
+  // fractional part of performed_ramp_up_steps in 1/65536 steps, which is
+  // accumulated on acceleration with a != d
+  uint16_t ramp_steps_frac;
   // Are the ticks stored of the last previous step, if pulse time requires
   // more than one command
   uint32_t pause_ticks_left;
@@ -88,10 +162,34 @@ class RampGenerator {
   // commandEnqueued() Reading ro variables is safe in application
   struct ramp_ro_s _ro;
   struct ramp_rw_s _rw;
+#if (FAS_RAMP_TABLE == 1)
+  // Built on acceleration change and used by _getNextCommand(), if it matches
+  // the acceleration of the ramp
+  RampTable _table;
+#endif
+
+  // Segment queue: written by application, consumed by getNextCommand()
+  struct ramp_segment_s _segments[RAMP_SEGMENT_QUEUE_LEN];
+  // config of the queued segments except min_travel_ticks. Only written by
+  // the application, while the segment queue is empty
+  struct ramp_config_s _seg_config;
+  volatile uint8_t _seg_read_idx;
+  volatile uint8_t _seg_write_idx;
+  // junction_ramp_steps of the running segment
+  uint32_t _seg_active_junction;
+  // target and direction of the last started or queued segment
+  int32_t _seg_last_target;
+  bool _seg_last_count_up;
+
+  // Target duration of one command at speeds above half of this
+  uint32_t _cmd_ticks;
+  upm_float _upm_cmd_ticks;
 
  public:
   uint32_t speed_in_ticks;
   uint32_t acceleration;
+  uint32_t deceleration;
+  uint32_t jerk;
   inline uint8_t rampState() {
     // reading one byte is atomic
     return _rw.ramp_state;
@@ -141,14 +239,50 @@ class RampGenerator {
   }
   int8_t setAcceleration(int32_t accel);
   uint32_t getAcceleration() { return acceleration; }
+  int8_t setDeceleration(int32_t decel);
+  uint32_t getDeceleration() {
+    // jerk limited ramp supports only symmetric ramps
+    if ((deceleration == 0) || (jerk != 0)) {
+      return acceleration;
+    }
+    return deceleration;
+  }
+  int8_t setJerk(uint32_t jerk);
+  uint32_t getJerk() { return jerk; }
   int32_t getCurrentAcceleration();
+  // Commands are planned to last this duration: longer commands reduce
+  // the interrupt and ramp calculation load, shorter ones the latency.
+  // Valid range is MIN_CMD_TICKS to 20ms. Returns 0 or -1 for invalid value
+  int8_t setCommandDurationInTicks(uint32_t cmd_ticks);
+  uint32_t getCommandDurationInTicks() { return _cmd_ticks; }
   inline bool hasValidConfig() {
     return ((_config.min_travel_ticks != 0) && (_config.upm_inv_accel2 != 0));
   }
   void applySpeedAcceleration();
   int8_t move(int32_t move, const struct queue_end_s *queue);
   int8_t moveTo(int32_t position, const struct queue_end_s *queue);
+  // moveTo() with speed/acceleration/deceleration applied only to this move.
+  // The configuration for later moves is not changed.
+  int8_t moveToWithLimits(int32_t position, const struct queue_end_s *queue,
+                          uint32_t min_step_ticks, uint32_t accel,
+                          uint32_t decel);
+  int8_t moveToInTime(int32_t position, uint32_t duration_ms,
+                      const struct queue_end_s *queue);
+  int8_t moveInTime(int32_t move, uint32_t duration_ms,
+                    const struct queue_end_s *queue);
+  // Estimated time in us to complete the running move and all queued
+  // segments starting with the queue end. 0xffffffff for keep running
+  uint32_t getRemainingTimeInUs(const struct queue_end_s *queue_end);
+  int8_t queueMoveTo(int32_t position, const struct queue_end_s *queue);
+  int8_t queueMove(int32_t move, const struct queue_end_s *queue);
+  inline uint8_t queuedSegments() {
+    noInterrupts();
+    uint8_t n = _seg_write_idx - _seg_read_idx;
+    interrupts();
+    return n;
+  }
   int8_t startRun(bool countUp);
+  int8_t setTargetSpeed(int32_t speed_mhz);
   inline void initiate_stop() { _ro.force_stop = true; }
   inline bool isStopping() { return _ro.force_stop && isRampGeneratorActive(); }
   bool isRampGeneratorActive();
@@ -174,9 +308,23 @@ class RampGenerator {
 
  private:
   int8_t _startMove(int32_t target_pos, int32_t current_target_pos);
+  int8_t _startRun(bool countUp, uint32_t target_ticks);
+  void _updateExitRampSteps();
+  void _advanceSegment(const struct queue_end_s *queue_end);
+  void _updateRampConfig();
+  void _updateJerkConfig();
+  upm_float _invAccel2(uint32_t decel);
+  uint32_t _jerkPeakAccel(uint32_t ticks);
+  // Returns the equivalent trapezoidal ramp steps at travel speed ticks and
+  // the steps of the jerk phases
+  uint32_t _jerkRampSteps(uint32_t ticks, uint32_t *bottom_steps,
+                          uint32_t *top_steps);
+  // Travel speed for a jerk limited move from standstill, which reaches
+  // the speed before the target
+  uint32_t _jerkStartTicks(int32_t target_pos, int32_t curr_pos);
 #if (TICKS_PER_S != 16000000L)
   upm_float upm_timer_freq;
-  upm_float upm_timer_freq_div_500;
 #endif
+  friend class FastAccelStepperTest;
 };
 #endif
@@ -40,9 +40,74 @@ enum channels { channelA, channelB, channelC };
 #define QUEUE_LEN 32
 #endif
 
+// The default queue length can be overridden by build flag e.g.
+// -DFAS_QUEUE_LEN=64 to ride out longer stalls of the fill task, or
+// -DFAS_QUEUE_LEN=8 to save RAM. Each entry needs 5 bytes (7 bytes with
+// FAS_EXTENDED_STEPS=1): the queue_entry with steps, flags, repeat and ticks
+// has 4 bytes (6 bytes with 16 bit steps and the repeat byte), plus 1 byte
+// in _marker_tag.
+#ifdef FAS_QUEUE_LEN
+#undef QUEUE_LEN
+#define QUEUE_LEN FAS_QUEUE_LEN
+#endif
+
 // These variables control the stepper timing behaviour
 #define QUEUE_LEN_MASK (QUEUE_LEN - 1)
 
+#if (QUEUE_LEN < 4) || ((QUEUE_LEN & QUEUE_LEN_MASK) != 0)
+#error "QUEUE_LEN must be a power of two and at least 4"
+#endif
+
+// read_idx/next_write_idx are free running and need to count up to
+// QUEUE_LEN entries. On avr the ISR and the application must access them
+// atomically, so only 8 bit indices are supported.
+#if (QUEUE_LEN <= 128)
+typedef uint8_t queue_idx_t;
+#elif defined(ARDUINO_ARCH_AVR)
+#error "QUEUE_LEN must not exceed 128 on avr"
+#elif (QUEUE_LEN <= 32768)
+typedef uint16_t queue_idx_t;
+#else
+#error "QUEUE_LEN must not exceed 32768"
+#endif
+
+// With FAS_POSITION_COUNTER=1 the ISR maintains the position at the end of
+// the command in execution. Then getCurrentPosition() needs constant time
+// instead of walking through the queue. The simulated ISR of the pc based
+// tests just advances read_idx, so default is off for those builds.
+#ifndef FAS_POSITION_COUNTER
+#if defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_ESP32)
+#define FAS_POSITION_COUNTER 1
+#else
+#define FAS_POSITION_COUNTER 0
+#endif
+#endif
+
+// read_idx/next_write_idx follow a single producer/single consumer
+// protocol: addQueueEntry() writes the entry and publishes it by storing
+// next_write_idx with release semantics, the ISR frees an entry by storing
+// read_idx with release semantics. The other side's index is loaded with
+// acquire semantics, so the entry contents are visible. This works across
+// the two cores of the esp32, where noInterrupts() gives no protection.
+//
+// On avr the 8 bit accesses are atomic and the ISR is not interrupted, so
+// plain accesses are used and the accessors keep disabling interrupts.
+#if defined(ARDUINO_ARCH_AVR)
+#define QUEUE_IDX_LOAD(idx) (idx)
+#define QUEUE_IDX_STORE(idx, val) (idx) = (val)
+#define QUEUE_LOCK() noInterrupts()
+#define QUEUE_UNLOCK() interrupts()
+#else
+#define QUEUE_IDX_LOAD(idx) __atomic_load_n(&(idx), __ATOMIC_ACQUIRE)
+#define QUEUE_IDX_STORE(idx, val) \
+  __atomic_store_n(&(idx), (queue_idx_t)(val), __ATOMIC_RELEASE)
+#define QUEUE_LOCK()
+#define QUEUE_UNLOCK()
+#endif
+
+// Size of the ring for executed markers. Must be a power of two
+#define MARKER_EVENTS 8
+
 #ifndef TEST
 #define inject_fill_interrupt(x)
 #endif
@@ -75,18 +140,37 @@ int16_t _esp32_readPulseCounter(uint8_t pcnt_unit);
 #endif
 
 struct queue_entry {
-  uint8_t steps;  // if 0,  then the command only adds a delay
+  cmd_steps_t steps;  // if 0,  then the command only adds a delay
   uint8_t toggle_dir : 1;
   uint8_t countUp : 1;
   uint8_t moreThanOneStep : 1;
   uint8_t hasSteps : 1;
+  // Pause only: number of repetitions after the first period of ticks
+#if (FAS_EXTENDED_STEPS == 1)
+  uint8_t repeat;  // padding byte in front of ticks
+#else
+  uint8_t repeat : 4;
+#endif
   uint16_t ticks;
 };
 class StepperQueue {
  public:
   struct queue_entry entry[QUEUE_LEN];
-  uint8_t read_idx;  // ISR stops if readptr == next_writeptr
-  uint8_t next_write_idx;
+  queue_idx_t read_idx;  // ISR stops if readptr == next_writeptr
+  queue_idx_t next_write_idx;
+  // Running sums of the ticks of all commands added to the queue and of all
+  // commands started by the ISR, which both wrap around. The difference is
+  // the ticks in the queue after the running command. Only addQueueEntry()
+  // updates _ticks_written and only the ISR advances _ticks_started.
+  uint32_t _ticks_written;
+  volatile uint32_t _ticks_started;
+  // Tag of a marker entry or 0
+  uint8_t _marker_tag[QUEUE_LEN];
+  // Ring of executed markers. The ISR writes and the application reads
+  uint8_t _marker_events[MARKER_EVENTS];
+  volatile uint8_t _marker_write;
+  volatile uint8_t _marker_read;
+  volatile uint8_t _lost_markers;
   bool dirHighCountsUp;
   uint8_t dirPin;
 #if defined(ARDUINO_ARCH_ESP32)
@@ -112,20 +196,187 @@ class StepperQueue {
 #endif
 
   struct queue_end_s queue_end;
+  struct queue_stats_s stats;
+#if (FAS_LATENCY_STATS == 1)
+  struct latency_stats_s latency;
+#endif
+#if (FAS_POSITION_COUNTER == 1)
+  // position after the command at read_idx or queue_end.pos for empty queue
+  volatile int32_t _isr_pos;
+#endif
+
+  // Ticks from start of the command e until start of the next command. The
+  // avr ISR decrements steps and repeat, so only valid for a not yet
+  // started command.
+  inline uint32_t _entryTicks(const struct queue_entry* e) {
+    if (e->moreThanOneStep) {
+      return (uint32_t)e->ticks * e->steps;
+    }
+    return (uint32_t)e->ticks * (uint8_t)(e->repeat + 1);
+  }
+  // Called by the ISR on start of the command e at read_idx
+  inline void _advanceIsrCounters(const struct queue_entry* e) {
+    _ticks_started += _entryTicks(e);
+#if (FAS_POSITION_COUNTER == 1)
+    _isr_pos += e->countUp ? e->steps : -(int32_t)e->steps;
+#endif
+  }
+#ifdef TEST
+  // ISR emulation of the pc based tests: the command at read_idx is done and
+  // the next one becomes current
+  void _testNextCommand() {
+    queue_idx_t rp = read_idx + 1;
+    QUEUE_IDX_STORE(read_idx, rp);
+    if (rp != next_write_idx) {
+      _advanceIsrCounters(&entry[rp & QUEUE_LEN_MASK]);
+      _reportMarker(rp);
+    }
+  }
+#endif
+  // Called with interrupts disabled, if the ISR has run out of commands.
+  // Then the commands after read_idx are not yet started.
+  inline void _resetIsrCounters() {
+    uint32_t ticks = _ticks_written;
+#if (FAS_POSITION_COUNTER == 1)
+    int32_t pos = queue_end.pos;
+#endif
+    queue_idx_t rp = read_idx;
+    queue_idx_t wp = next_write_idx;
+    if (rp != wp) {
+      while (++rp != wp) {
+        struct queue_entry* e = &entry[rp & QUEUE_LEN_MASK];
+        ticks -= _entryTicks(e);
+#if (FAS_POSITION_COUNTER == 1)
+        pos -= e->countUp ? e->steps : -(int32_t)e->steps;
+#endif
+      }
+    }
+    _ticks_started = ticks;
+#if (FAS_POSITION_COUNTER == 1)
+    _isr_pos = pos;
+#endif
+  }
+  // Called, when the entry at rp becomes the current command: by the ISR
+  // after read_idx has advanced to rp or on adding to an empty queue. For a
+  // marker all steps in front have been performed then
+  inline void _reportMarker(queue_idx_t rp) {
+    uint8_t tag = _marker_tag[rp & QUEUE_LEN_MASK];
+    if (tag != 0) {
+      uint8_t w = _marker_write;
+      if ((uint8_t)(w - QUEUE_IDX_LOAD(_marker_read)) < MARKER_EVENTS) {
+        _marker_events[w & (MARKER_EVENTS - 1)] = tag;
+        QUEUE_IDX_STORE(_marker_write, w + 1);
+      } else {
+        _lost_markers++;
+      }
+    }
+  }
+  // Returns the tag of the oldest executed marker or 0
+  uint8_t getMarkerEvent() {
+    uint8_t r = _marker_read;
+    if (r == QUEUE_IDX_LOAD(_marker_write)) {
+      return 0;
+    }
+    uint8_t tag = _marker_events[r & (MARKER_EVENTS - 1)];
+    QUEUE_IDX_STORE(_marker_read, r + 1);
+    return tag;
+  }
+  // Shift current and future position. Call with interrupts disabled
+  inline void adjustPosition(int32_t delta) {
+    queue_end.pos += delta;
+#if (FAS_POSITION_COUNTER == 1)
+    _isr_pos += delta;
+#endif
+  }
+
+  // Called by fill_queue() for a queue, which has been filled for the
+  // running ramp before
+  inline void _updateStats(uint32_t lead_ticks, bool underrun) {
+    stats.fills++;
+    if (underrun) {
+      stats.underruns++;
+      lead_ticks = 0;
+    }
+    stats.min_lead_ticks = min(stats.min_lead_ticks, lead_ticks);
+  }
+  inline void _resetStats() {
+    stats.fills = 0;
+    stats.underruns = 0;
+    stats.min_lead_ticks = 0xffffffff;
+  }
+
+  // Bin of value for the latency histograms. Binary search with a constant
+  // number of steps, as this is called by the ISR
+  static inline uint8_t _latencyBin(uint16_t value) {
+    uint8_t bin = 0;
+    if (value >= 256) {
+      bin = 8;
+      value >>= 8;
+    }
+    if (value >= 16) {
+      bin += 4;
+      value >>= 4;
+    }
+    if (value >= 4) {
+      bin += 2;
+      value >>= 2;
+    }
+    if (value >= 2) {
+      bin += 1;
+      value >>= 1;
+    }
+    bin += value;
+    return min(bin, (uint8_t)(LATENCY_BINS - 1));
+  }
+  static inline void _latencyAdd(uint16_t* histogram, uint16_t value) {
+    uint8_t bin = _latencyBin(value);
+    if (++histogram[bin] == 0xffff) {
+      for (uint8_t i = 0; i < LATENCY_BINS; i++) {
+        histogram[i] >>= 1;
+      }
+    }
+  }
+#if (FAS_LATENCY_STATS == 1)
+  // Called by the ISR before return with its run time
+  inline void _recordIsrTicks(uint16_t ticks) {
+    _latencyAdd(latency.isr_ticks, ticks);
+  }
+  // Called by fill_queue() for an active ramp generator
+  inline void _recordFill(uint32_t start_us, uint8_t commands) {
+    uint32_t us = micros() - start_us;
+    _latencyAdd(latency.fill_us, min(us, (uint32_t)0xffff));
+    _latencyAdd(latency.fill_commands, commands);
+  }
+  inline void _resetLatencyStats() {
+    for (uint8_t i = 0; i < LATENCY_BINS; i++) {
+      latency.fill_us[i] = 0;
+      latency.fill_commands[i] = 0;
+      latency.isr_ticks[i] = 0;
+    }
+  }
+#else
+  inline void _recordIsrTicks(uint16_t ticks) { (void)ticks; }
+  inline void _recordFill(uint32_t start_us, uint8_t commands) {
+    (void)start_us;
+    (void)commands;
+  }
+  inline void _resetLatencyStats() {}
+#endif
 
   void init(uint8_t queue_num, uint8_t step_pin);
-  inline uint8_t queueEntries() {
-    noInterrupts();
-    uint8_t rp = read_idx;
-    uint8_t wp = next_write_idx;
-    interrupts();
+  inline queue_idx_t queueEntries() {
+    QUEUE_LOCK();
+    queue_idx_t rp = QUEUE_IDX_LOAD(read_idx);
+    queue_idx_t wp = QUEUE_IDX_LOAD(next_write_idx);
+    QUEUE_UNLOCK();
     inject_fill_interrupt(0);
-    return (uint8_t)(wp - rp);
+    return (queue_idx_t)(wp - rp);
   }
   inline bool isQueueFull() { return queueEntries() == QUEUE_LEN; }
   inline bool isQueueEmpty() { return queueEntries() == 0; }
 
-  int8_t addQueueEntry(const struct stepper_command_s* cmd, bool start) {
+  int8_t addQueueEntry(const struct stepper_command_s* cmd, bool start,
+                       uint8_t repeat = 0, uint8_t tag = 0) {
     // Just to check if, if the struct has the correct size
     // if (sizeof(entry) != 6 * QUEUE_LEN) {
     //  return -1;
@@ -139,12 +390,60 @@ class StepperQueue {
     if (isQueueFull()) {
       return AQE_QUEUE_FULL;
     }
+    int8_t res = _writeEntry(cmd, next_write_idx, isQueueEmpty(), repeat);
+    if (res == AQE_OK) {
+      _marker_tag[next_write_idx & QUEUE_LEN_MASK] = tag;
+      commandAddedToQueue(start, 1);
+    }
+    return res;
+  }
+  // Copy up to n commands into the queue and publish them at once.
+  // Stops at a full queue or at the first invalid command.
+  // Returns the number of added commands
+  uint16_t addQueueEntries(const struct stepper_command_s* cmds, uint16_t n,
+                           bool start) {
+    queue_idx_t entries = queueEntries();
+    uint16_t free_entries = QUEUE_LEN - entries;
+    n = min(n, free_entries);
+    queue_idx_t wp = next_write_idx;
+    uint16_t added = 0;
+    while (added < n) {
+      bool empty = (entries == 0) && (added == 0);
+      if (_writeEntry(&cmds[added], wp + added, empty, 0) != AQE_OK) {
+        break;
+      }
+      _marker_tag[(queue_idx_t)(wp + added) & QUEUE_LEN_MASK] = 0;
+      added++;
+    }
+    if (added > 0) {
+      commandAddedToQueue(start, added);
+    }
+    return added;
+  }
+  // Write the command to entry wp without publishing it to the ISR
+  int8_t _writeEntry(const struct stepper_command_s* cmd, queue_idx_t wp,
+                     bool queue_empty, uint8_t repeat) {
     uint16_t period = cmd->ticks;
-    uint8_t steps = cmd->steps;
+    cmd_steps_t steps = cmd->steps;
     // Serial.print(period);
     // Serial.print(" ");
     // Serial.println(steps);
 
+#if (FAS_EXTENDED_STEPS == 1)
+    // 8 bit steps cannot exceed MAX_CMD_STEPS
+    if (steps > MAX_CMD_STEPS) {
+      return AQE_ERROR_STEPS_TOO_HIGH;
+    }
+#endif
+    if ((repeat != 0) && (steps != 0)) {
+      return AQE_ERROR_INVALID_REPEAT;
+    }
+#if (MAX_PAUSE_REPEAT < 255)
+    if (repeat > MAX_PAUSE_REPEAT) {
+      return AQE_ERROR_INVALID_REPEAT;
+    }
+#endif
+    // Each repetition of a pause needs an interrupt
     uint32_t command_rate_ticks = period;
     if (steps > 1) {
       command_rate_ticks *= steps;
@@ -152,14 +451,14 @@ class StepperQueue {
     if (command_rate_ticks < MIN_CMD_TICKS) {
       return AQE_ERROR_TICKS_TOO_LOW;
     }
+    command_rate_ticks *= (uint32_t)repeat + 1;
 
-    uint8_t wp = next_write_idx;
     struct queue_entry* e = &entry[wp & QUEUE_LEN_MASK];
     queue_end.pos += cmd->count_up ? steps : -steps;
     bool dir = (cmd->count_up == dirHighCountsUp);
     bool toggle_dir = false;
     if (dirPin != PIN_UNDEFINED) {
-      if (isQueueEmpty()) {
+      if (queue_empty) {
         // set the dirPin here. Necessary with shared direction pins
         digitalWrite(dirPin, dir);
         queue_end.dir = dir;
@@ -172,7 +471,9 @@ class StepperQueue {
     e->countUp = cmd->count_up ? 1 : 0;
     e->moreThanOneStep = steps > 1 ? 1 : 0;
     e->hasSteps = steps > 0 ? 1 : 0;
+    e->repeat = repeat;
     e->ticks = period;
+    _ticks_written += command_rate_ticks;
     queue_end.dir = dir;
     queue_end.count_up = cmd->count_up;
 #if (TEST_CREATE_QUEUE_CHECKSUM == 1)
@@ -190,17 +491,46 @@ class StepperQueue {
       }
     }
 #endif
-    commandAddedToQueue(start);
     return AQE_OK;
   }
+#if (FAS_POSITION_COUNTER == 1)
+  int32_t getCurrentPosition() {
+    noInterrupts();
+    int32_t pos = _isr_pos;
+    queue_idx_t rp = QUEUE_IDX_LOAD(read_idx);
+    if (rp == next_write_idx) {
+      interrupts();
+      return pos;
+    }
+    // remove the not yet performed steps of the command in execution
+    struct queue_entry* e = &entry[rp & QUEUE_LEN_MASK];
+    bool count_up = e->countUp;
+    cmd_steps_t steps = e->steps;
+#if defined(ARDUINO_ARCH_ESP32)
+    bool toggle_dir = e->toggle_dir;
+    // pulse counter should go max up to MAX_CMD_STEPS with perhaps few pulses
+    // overrun, so this conversion is safe
+    int16_t done_p = (int16_t)_getPerformedPulses();
+#endif
+    interrupts();
+#if defined(ARDUINO_ARCH_ESP32)
+    if (toggle_dir) {
+      done_p = -done_p;
+    }
+    pos += count_up ? done_p : -done_p;
+#endif
+    pos += count_up ? -(int32_t)steps : steps;
+    return pos;
+  }
+#else
   int32_t getCurrentPosition() {
     noInterrupts();
     int32_t pos = queue_end.pos;
-    uint8_t wp = next_write_idx;
-    uint8_t rp = read_idx;
+    queue_idx_t wp = next_write_idx;
+    queue_idx_t rp = QUEUE_IDX_LOAD(read_idx);
 #if defined(ARDUINO_ARCH_ESP32)
-    // pulse counter should go max up to 255 with perhaps few pulses overrun, so
-    // this conversion is safe
+    // pulse counter should go max up to MAX_CMD_STEPS with perhaps few pulses
+    // overrun, so this conversion is safe
     int16_t done_p = (int16_t)_getPerformedPulses();
 #endif
     interrupts();
@@ -227,57 +557,29 @@ class StepperQueue {
 #endif
     return pos;
   }
+#endif
+  // Ticks of all entries in the queue without the currently processed entry
   uint32_t ticksInQueue() {
-    noInterrupts();
-    uint8_t rp = read_idx;
-    uint8_t wp = next_write_idx;
-    interrupts();
-    if (wp == rp) {
+    QUEUE_LOCK();
+    queue_idx_t rp = QUEUE_IDX_LOAD(read_idx);
+    if (rp == next_write_idx) {
+      QUEUE_UNLOCK();
       return 0;
     }
-    uint32_t ticks = 0;
-    rp++;  // ignore currently processed entry
-    while (wp != rp) {
-      struct queue_entry* e = &entry[rp++ & QUEUE_LEN_MASK];
-      ticks += e->ticks;
-      uint8_t steps = e->steps;
-      if (steps > 1) {
-        uint32_t tmp = e->ticks;
-        tmp *= steps - 1;
-        ticks += tmp;
-      }
-    }
+    uint32_t ticks = _ticks_written - _ticks_started;
+    QUEUE_UNLOCK();
     return ticks;
   }
   bool hasTicksInQueue(uint32_t min_ticks) {
-    noInterrupts();
-    uint8_t rp = read_idx;
-    uint8_t wp = next_write_idx;
-    interrupts();
-    if (wp == rp) {
-      return false;
-    }
-    rp++;  // ignore currently processed entry
-    while (wp != rp) {
-      struct queue_entry* e = &entry[rp & QUEUE_LEN_MASK];
-      uint32_t tmp = e->ticks;
-      uint8_t steps = max(e->steps, 1);
-      tmp *= steps;
-      if (tmp >= min_ticks) {
-        return true;
-      }
-      min_ticks -= tmp;
-      rp++;
-    }
-    return false;
+    return ticksInQueue() >= min_ticks;
   }
   uint16_t getActualTicks() {
     // Retrieve current step rate from the current view.
     // This is valid only, if the command describes more than one step
-    noInterrupts();
-    uint8_t rp = read_idx;
-    uint8_t wp = next_write_idx;
-    interrupts();
+    QUEUE_LOCK();
+    queue_idx_t rp = QUEUE_IDX_LOAD(read_idx);
+    queue_idx_t wp = QUEUE_IDX_LOAD(next_write_idx);
+    QUEUE_UNLOCK();
     if (wp == rp) {
       return 0;
     }
@@ -295,17 +597,34 @@ class StepperQueue {
     return 0;
   }
 
-  // startQueue is always called
-  void commandAddedToQueue(bool start);
+  // startQueue is always called. n commands have been written after
+  // next_write_idx and are published by this call
+  void commandAddedToQueue(bool start, queue_idx_t n);
   int8_t startPreparedQueue();
+  // Start the prepared queues fas_queue[n] selected by bit n of queue_mask
+  // together. Already running queues are not affected
+  static int8_t startPreparedQueues(uint8_t queue_mask);
+  // Queue has been started. On esp32 a prepared queue reports isRunning()
+  // already, so starting of queues has to check this instead
+  bool _isStarted();
+  // Remove the started queues from queue_mask. Returns
+  // AQE_ERROR_EMPTY_QUEUE_TO_START, if a selected queue is empty
+  static int8_t _selectQueuesToStart(uint8_t* queue_mask);
   void forceStop();
   void _initVars() {
     dirPin = PIN_UNDEFINED;
     read_idx = 0;
     next_write_idx = 0;
+    _ticks_written = 0;
+    _marker_write = 0;
+    _marker_read = 0;
+    _lost_markers = 0;
     queue_end.dir = true;
     queue_end.count_up = true;
     queue_end.pos = 0;
+    _resetIsrCounters();
+    _resetStats();
+    _resetLatencyStats();
     dirHighCountsUp = true;
 #if defined(ARDUINO_ARCH_AVR)
     _isRunning = false;
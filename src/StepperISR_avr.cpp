@@ -110,6 +110,23 @@ void StepperQueue::init(uint8_t queue_num, uint8_t step_pin) {
 #endif
 }
 
+// Record the run time since isr_start for the latency statistics and leave.
+// The paths for another step or a repeated pause of the same command just
+// call exitStepperISR(), so the histogram costs only once per command. The
+// step after _prepareForStop with the 3us delay is the longest path and is
+// always recorded.
+#if (FAS_LATENCY_STATS == 1)
+#define startStepperISR(T) uint16_t isr_start = TCNT##T
+#define leaveStepperISR(T, CHANNEL)                                        \
+  {                                                                        \
+    fas_queue_##CHANNEL._recordIsrTicks((uint16_t)(TCNT##T - isr_start)); \
+    exitStepperISR();                                                      \
+  }
+#else
+#define startStepperISR(T)
+#define leaveStepperISR(T, CHANNEL) exitStepperISR()
+#endif
+
 // The interrupt is called on compare event, which eventually
 // generates a L->H transition. In any case, the current command's
 // wait time has still to be executed for the next command, if any.
@@ -120,7 +137,8 @@ void StepperQueue::init(uint8_t queue_num, uint8_t step_pin) {
 #define AVR_STEPPER_ISR(T, CHANNEL)                                           \
   ISR(TIMER##T##_COMP##CHANNEL##_vect) {                                      \
     enterStepperISR();                                                        \
-    uint8_t rp = fas_queue_##CHANNEL.read_idx;                                \
+    startStepperISR(T);                                                       \
+    queue_idx_t rp = fas_queue_##CHANNEL.read_idx;                            \
     if (rp == fas_queue_##CHANNEL.next_write_idx) {                           \
       /* queue is empty => set to disconnect */                               \
       Stepper_Disconnect(T, CHANNEL);                                         \
@@ -130,7 +148,7 @@ void StepperQueue::init(uint8_t queue_num, uint8_t step_pin) {
       DisableCompareInterrupt(T, CHANNEL);                                    \
       fas_queue_##CHANNEL._isRunning = false;                                 \
       fas_queue_##CHANNEL._prepareForStop = false;                            \
-      exitStepperISR();                                                       \
+      leaveStepperISR(T, CHANNEL);                                            \
       return;                                                                 \
     }                                                                         \
     struct queue_entry* e = &fas_queue_##CHANNEL.entry[rp & QUEUE_LEN_MASK];  \
@@ -163,16 +181,24 @@ void StepperQueue::init(uint8_t queue_num, uint8_t step_pin) {
         if (e->steps-- > 1) {                                                 \
           /* perform another step with this queue entry */                    \
           Stepper_One(T, CHANNEL);                                            \
-          exitStepperISR();                                                   \
+          leaveStepperISR(T, CHANNEL);                                        \
           return;                                                             \
         }                                                                     \
       }                                                                       \
     }                                                                         \
+    if (e->repeat != 0) {                                                     \
+      /* repeat the pause of this queue entry */                              \
+      e->repeat--;                                                            \
+      exitStepperISR();                                                       \
+      return;                                                                 \
+    }                                                                         \
     rp++;                                                                     \
     fas_queue_##CHANNEL.read_idx = rp;                                        \
     if (rp != fas_queue_##CHANNEL.next_write_idx) {                           \
       /* command in queue */                                                  \
       e = &fas_queue_##CHANNEL.entry[rp & QUEUE_LEN_MASK];                    \
+      fas_queue_##CHANNEL._advanceIsrCounters(e);                             \
+      fas_queue_##CHANNEL._reportMarker(rp);                                  \
       if (e->steps != 0) {                                                    \
         Stepper_One(T, CHANNEL);                                              \
       }                                                                       \
@@ -182,7 +208,7 @@ void StepperQueue::init(uint8_t queue_num, uint8_t step_pin) {
     } else {                                                                  \
       fas_queue_##CHANNEL._prepareForStop = true;                             \
     }                                                                         \
-    exitStepperISR();                                                         \
+    leaveStepperISR(T, CHANNEL);                                              \
   }
 
 #define AVR_STEPPER_ISR_GEN(T, CHANNEL) AVR_STEPPER_ISR(T, CHANNEL)
@@ -226,9 +252,9 @@ AVR_CYCLIC_ISR_GEN(FAS_TIMER_MODULE)
     *fas_queue_##CHANNEL._dirPinPort ^= fas_queue_##CHANNEL._dirPinMask; \
   }
 
-#define AVR_START_QUEUE(T, CHANNEL)              \
-  _isRunning = true;                             \
-  _prepareForStop = false;                       \
+#define AVR_ARM_QUEUE(T, CHANNEL)                \
+  fas_queue_##CHANNEL._isRunning = true;         \
+  fas_queue_##CHANNEL._prepareForStop = false;   \
   /* ensure no compare event */                  \
   SetTimerCompareRelative(T, CHANNEL, 32768);    \
   /* set output one, if steps to be generated */ \
@@ -240,14 +266,41 @@ AVR_CYCLIC_ISR_GEN(FAS_TIMER_MODULE)
   /* clear interrupt flag */                     \
   ClearInterruptFlag(T, CHANNEL);                \
   /* enable compare interrupt */                 \
-  EnableCompareInterrupt(T, CHANNEL);            \
-  /* start */                                    \
+  EnableCompareInterrupt(T, CHANNEL);
+
+#define AVR_START_QUEUE(T, CHANNEL) \
+  AVR_ARM_QUEUE(T, CHANNEL)         \
+  /* start */                       \
   SetTimerCompareRelative(T, CHANNEL, 10);
 
-void StepperQueue::commandAddedToQueue(bool start) {
+// All channels share one timer. So the queues are armed first and then the
+// first compare event of all queues is set to the same timer value. The
+// margin covers the writes of the compare registers.
+#define SYNC_START_MARGIN_TICKS 64
+#define SetTimerCompare(T, X, V) OCR##T##X = V
+#define GetTimerCounter(T) TCNT##T
+#define AVR_SYNC_COMPARE(T) (GetTimerCounter(T) + SYNC_START_MARGIN_TICKS)
+
+#define AVR_ARM_SELECTED_QUEUE(T, CHANNEL)  \
+  if (queue_mask & _BV(channel##CHANNEL)) { \
+    GET_ENTRY_PTR(T, CHANNEL)               \
+    AVR_ARM_QUEUE(T, CHANNEL)               \
+  }
+
+#define AVR_START_SELECTED_QUEUE(T, CHANNEL) \
+  if (queue_mask & _BV(channel##CHANNEL)) {  \
+    SetTimerCompare(T, CHANNEL, compare);    \
+  }
+
+void StepperQueue::commandAddedToQueue(bool start, queue_idx_t n) {
   // Check if this is the first command and advance write pointer
   noInterrupts();
-  bool first = (next_write_idx++ == read_idx);
+  bool first = (next_write_idx == read_idx);
+  next_write_idx += n;
+  if (first) {
+    _resetIsrCounters();
+    _reportMarker(read_idx);
+  }
   if (_isRunning) {
     interrupts();
     return;
@@ -260,7 +313,7 @@ void StepperQueue::commandAddedToQueue(bool start) {
     return;
   }
 
-  uint8_t rp;
+  queue_idx_t rp;
   struct queue_entry* e;
 
   switch (channel) {
@@ -295,7 +348,7 @@ int8_t StepperQueue::startPreparedQueue() {
     return AQE_ERROR_EMPTY_QUEUE_TO_START;
   }
 
-  uint8_t rp;
+  queue_idx_t rp;
   struct queue_entry* e;
   switch (channel) {
     case channelA:
@@ -316,6 +369,32 @@ int8_t StepperQueue::startPreparedQueue() {
   return AQE_OK;
 }
 
+bool StepperQueue::_isStarted() { return _isRunning; }
+
+int8_t StepperQueue::startPreparedQueues(uint8_t queue_mask) {
+  int8_t res = _selectQueuesToStart(&queue_mask);
+  if (res != AQE_OK) {
+    return res;
+  }
+
+  queue_idx_t rp;
+  struct queue_entry* e;
+  noInterrupts();
+  AVR_ARM_SELECTED_QUEUE(FAS_TIMER_MODULE, A)
+  AVR_ARM_SELECTED_QUEUE(FAS_TIMER_MODULE, B)
+#ifdef stepPinStepperC
+  AVR_ARM_SELECTED_QUEUE(FAS_TIMER_MODULE, C)
+#endif
+  uint16_t compare = AVR_SYNC_COMPARE(FAS_TIMER_MODULE);
+  AVR_START_SELECTED_QUEUE(FAS_TIMER_MODULE, A)
+  AVR_START_SELECTED_QUEUE(FAS_TIMER_MODULE, B)
+#ifdef stepPinStepperC
+  AVR_START_SELECTED_QUEUE(FAS_TIMER_MODULE, C)
+#endif
+  interrupts();
+  return AQE_OK;
+}
+
 #define FORCE_STOP(T, CHANNEL)               \
   {                                          \
     /* disable compare interrupt */          \
@@ -343,6 +422,7 @@ void StepperQueue::forceStop() {
 
   // empty the queue
   read_idx = next_write_idx;
+  _resetIsrCounters();
 }
 void StepperQueue::connect() {}
 void StepperQueue::disconnect() {}
@@ -2,6 +2,7 @@
 #include "StepperISR.h"
 
 #if defined(ARDUINO_ARCH_ESP32)
+#include <xtensa/hal.h>
 
 #define DEFAULT_TIMER_H_L_TRANSITION 160
 
@@ -83,7 +84,7 @@ static struct mapping_s queue2mapping[NUM_QUEUES] = {
 static void IRAM_ATTR
 prepare_for_next_command(StepperQueue *queue,
                          const struct queue_entry *e_next) {
-    uint8_t next_steps = e_next->steps;
+    cmd_steps_t next_steps = e_next->steps;
     if (next_steps > 0) {
       const struct mapping_s *mapping = queue->mapping;
       pcnt_unit_t pcnt_unit = mapping->pcnt_unit;
@@ -103,7 +104,7 @@ static void IRAM_ATTR apply_command(StepperQueue *queue,
   mcpwm_dev_t *mcpwm = mcpwm_unit == MCPWM_UNIT_0 ? &MCPWM0 : &MCPWM1;
   pcnt_unit_t pcnt_unit = mapping->pcnt_unit;
   uint8_t timer = mapping->timer;
-  uint8_t steps = e->steps;
+  cmd_steps_t steps = e->steps;
   if (e->toggle_dir) {
     *queue->_dirPinPort ^= queue->_dirPinMask;
   }
@@ -187,22 +188,24 @@ static void IRAM_ATTR init_stop(StepperQueue *q) {
   q->_hasISRactive = false;
 }
 
-static void IRAM_ATTR what_is_next(StepperQueue *q) {
+static void IRAM_ATTR next_command(StepperQueue *q) {
   bool isPrepared = q->_nextCommandIsPrepared;
   q->_nextCommandIsPrepared = false;
-  uint8_t rp = q->read_idx;
-  if (rp != q->next_write_idx) { 
+  queue_idx_t rp = q->read_idx;
+  if (rp != QUEUE_IDX_LOAD(q->next_write_idx)) {
 	rp++;
-	q->read_idx = rp;
-    if (rp != q->next_write_idx) {
+	QUEUE_IDX_STORE(q->read_idx, rp);
+    if (rp != QUEUE_IDX_LOAD(q->next_write_idx)) {
       struct queue_entry *e_curr = &q->entry[rp & QUEUE_LEN_MASK];
+      q->_advanceIsrCounters(e_curr);
+      q->_reportMarker(rp);
 	  if (!isPrepared) {
 		  prepare_for_next_command(q, e_curr);
 		  isr_pcnt_counter_clear(q->mapping->pcnt_unit);
 	  }
       apply_command(q, e_curr);
 	  rp++;
-      if (rp != q->next_write_idx) {
+      if (rp != QUEUE_IDX_LOAD(q->next_write_idx)) {
         struct queue_entry *e_next = &q->entry[rp & QUEUE_LEN_MASK];
 		q->_nextCommandIsPrepared = true;
         prepare_for_next_command(q, e_next);
@@ -214,18 +217,37 @@ static void IRAM_ATTR what_is_next(StepperQueue *q) {
   init_stop(q);
 }
 
+// Record the run time in ticks for the latency statistics
+static void IRAM_ATTR what_is_next(StepperQueue *q) {
+#if (FAS_LATENCY_STATS == 1)
+  uint32_t start = xthal_get_ccount();
+  next_command(q);
+  uint32_t cycles = xthal_get_ccount() - start;
+  q->_recordIsrTicks(cycles / (F_CPU / TICKS_PER_S));
+#else
+  next_command(q);
+#endif
+}
+
 static void IRAM_ATTR pcnt_isr_service(void *arg) {
   StepperQueue *q = (StepperQueue *)arg;
   what_is_next(q);
 }
 
-// MCPWM_SERVICE is only used in case of pause
-#define MCPWM_SERVICE(mcpwm, TIMER, pcnt)             \
-  if (mcpwm.int_st.cmpr##TIMER##_tea_int_st != 0) {   \
-    /*managed in apply_command()                   */ \
-    /*mcpwm.int_clr.cmpr##TIMER##_tea_int_clr = 1;*/  \
-    StepperQueue *q = &fas_queue[pcnt];               \
-    what_is_next(q);                                  \
+// MCPWM_SERVICE is only used in case of pause. A repeated pause keeps the
+// period and just waits for the next period's interrupt
+#define MCPWM_SERVICE(mcpwm, TIMER, pcnt)                             \
+  if (mcpwm.int_st.cmpr##TIMER##_tea_int_st != 0) {                   \
+    StepperQueue *q = &fas_queue[pcnt];                               \
+    struct queue_entry *e = &q->entry[q->read_idx & QUEUE_LEN_MASK]; \
+    if (e->repeat != 0) {                                             \
+      e->repeat--;                                                    \
+      mcpwm.int_clr.val = q->mapping->cmpr_tea_int_clr;               \
+    } else {                                                          \
+      /*managed in apply_command()                   */               \
+      /*mcpwm.int_clr.cmpr##TIMER##_tea_int_clr = 1;*/                \
+      what_is_next(q);                                                \
+    }                                                                 \
   }
 
 static void IRAM_ATTR mcpwm0_isr_service(void *arg) {
@@ -371,13 +393,27 @@ bool StepperQueue::isRunning() {
   return (mcpwm->timer[timer].mode.start == 2);  // 2=run continuous
 }
 
-void StepperQueue::commandAddedToQueue(bool start) {
+// commandAddedToQueue() sets _hasISRactive already for a prepared queue, so
+// only the timer in continuous mode tells a started queue
+bool StepperQueue::_isStarted() {
+  mcpwm_unit_t mcpwm_unit = mapping->mcpwm_unit;
+  mcpwm_dev_t *mcpwm = mcpwm_unit == MCPWM_UNIT_0 ? &MCPWM0 : &MCPWM1;
+  return (mcpwm->timer[mapping->timer].mode.start == 2);  // 2=run continuous
+}
+
+void StepperQueue::commandAddedToQueue(bool start, queue_idx_t n) {
 #ifdef TEST_PROBE
   // The time used by this command can have an impact
   digitalWrite(TEST_PROBE, digitalRead(TEST_PROBE) == HIGH ? LOW : HIGH);
 #endif
   noInterrupts();
-  bool first = (next_write_idx++ == read_idx);
+  queue_idx_t wp = next_write_idx;
+  bool first = (wp == QUEUE_IDX_LOAD(read_idx));
+  QUEUE_IDX_STORE(next_write_idx, wp + n);
+  if (first) {
+    _resetIsrCounters();
+    _reportMarker(read_idx);
+  }
   if (_hasISRactive) {
     interrupts();
     return;
@@ -419,9 +455,29 @@ int8_t StepperQueue::startPreparedQueue() {
   mcpwm->timer[timer].mode.start = 2;  // 2=run continuous
   return AQE_OK;
 }
+// The mcpwm timers of the queues are independent. So the timers are started
+// back to back with interrupts disabled.
+int8_t StepperQueue::startPreparedQueues(uint8_t queue_mask) {
+  int8_t res = _selectQueuesToStart(&queue_mask);
+  if (res != AQE_OK) {
+    return res;
+  }
+  noInterrupts();
+  for (uint8_t i = 0; i < NUM_QUEUES; i++) {
+    if (queue_mask & (1 << i)) {
+      const struct mapping_s *mapping = fas_queue[i].mapping;
+      mcpwm_unit_t mcpwm_unit = mapping->mcpwm_unit;
+      mcpwm_dev_t *mcpwm = mcpwm_unit == MCPWM_UNIT_0 ? &MCPWM0 : &MCPWM1;
+      mcpwm->timer[mapping->timer].mode.start = 2;  // 2=run continuous
+    }
+  }
+  interrupts();
+  return AQE_OK;
+}
 void StepperQueue::forceStop() {
   init_stop(this);
-  read_idx = next_write_idx;
+  QUEUE_IDX_STORE(read_idx, next_write_idx);
+  _resetIsrCounters();
 }
 bool StepperQueue::isValidStepPin(uint8_t step_pin) { return true; }
 int8_t StepperQueue::queueNumForStepPin(uint8_t step_pin) { return -1; }
@@ -1,11 +1,39 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+// A command holds up to 255 steps. With FAS_EXTENDED_STEPS=1 up to 32767
+// steps are possible, which reduces the command rate on long coasting at high
+// speed, if the command duration is increased by setCommandDurationInUs().
+// Each queue entry needs 2 bytes more. Default is on for esp32, where the
+// 16 bit pulse counter counts the steps of a command. On avr the ISR is
+// faster with 8 bit steps.
+#ifndef FAS_EXTENDED_STEPS
+#if defined(ARDUINO_ARCH_ESP32)
+#define FAS_EXTENDED_STEPS 1
+#else
+#define FAS_EXTENDED_STEPS 0
+#endif
+#endif
+
+// A pause can be repeated by the ISR up to MAX_PAUSE_REPEAT times without
+// using further queue entries. The repeat count uses otherwise unused bits
+// of the queue entry, so the limit depends on FAS_EXTENDED_STEPS.
+#if (FAS_EXTENDED_STEPS == 1)
+typedef uint16_t cmd_steps_t;
+#define MAX_CMD_STEPS 32767
+#define MAX_PAUSE_REPEAT 255
+#else
+typedef uint8_t cmd_steps_t;
+#define MAX_CMD_STEPS 255
+#define MAX_PAUSE_REPEAT 15
+#endif
+
 //	ticks is multiplied by (1/TICKS_PER_S) in s
 //	If steps is 0, then a pause is generated
+//	steps must not exceed MAX_CMD_STEPS
 struct stepper_command_s {
   uint16_t ticks;
-  uint8_t steps;
+  cmd_steps_t steps;
   bool count_up;
 };
 
@@ -8,6 +8,8 @@ class RampChecker {
   bool decrease_ok;
   bool first;
   bool dir_high;
+  bool dir_known;
+  bool count_up;
   bool reversing_allowed;
   uint32_t accelerate_till;
   uint32_t coast_till;
@@ -30,10 +32,11 @@ class RampChecker {
   RampChecker() {
     total_ticks = 0;
     pos = 0;
+    dir_known = false;
     next_ramp();
   }
   void check_section(struct queue_entry *e) {
-    uint8_t steps = e->steps;
+    cmd_steps_t steps = e->steps;
     if (steps == 0) {
       // Just a pause
       if (ticks_since_last_step <= 0xffff0000) {
@@ -43,13 +46,17 @@ class RampChecker {
       printf("process pause %d => %u\n", e->ticks, ticks_since_last_step);
       return;
     }
-    if (e->toggle_dir) {
+    // The direction is taken from countUp, because on an empty queue the
+    // direction pin is set directly and toggle_dir is not used
+    if (dir_known && (e->countUp != count_up)) {
       assert(reversing_allowed);
       dir_high = !dir_high;
       increase_ok = true;
       last_dt = ~0;
       decrease_ok = false;
     }
+    dir_known = true;
+    count_up = e->countUp;
     if (dir_high) {
       pos += steps;
     } else {
@@ -97,3 +104,69 @@ class RampChecker {
     first = false;
   }
 };
+
+// JerkChecker records the time of each step in addition to the RampChecker
+// checks. From this the position is interpolated at equidistant sample times
+// and the jerk is derived as third difference of the position.
+#define JERK_CHECKER_MAX_STEPS 500000
+class JerkChecker : public RampChecker {
+ public:
+  uint64_t *step_ticks;
+  uint32_t step_cnt;
+  uint64_t curr_ticks;
+
+  JerkChecker() {
+    step_ticks = (uint64_t *)malloc(JERK_CHECKER_MAX_STEPS * sizeof(uint64_t));
+    step_cnt = 0;
+    curr_ticks = 0;
+  }
+  void check_section(struct queue_entry *e) {
+    for (cmd_steps_t i = 0; i < e->steps; i++) {
+      assert(step_cnt < JERK_CHECKER_MAX_STEPS);
+      step_ticks[step_cnt++] = curr_ticks;
+      curr_ticks += e->ticks;
+    }
+    if (e->steps == 0) {
+      curr_ticks += e->ticks;
+    }
+    RampChecker::check_section(e);
+  }
+  // position in steps at given time with linear interpolation between steps
+  double position_at(uint64_t t, uint32_t *hint) {
+    uint32_t i = *hint;
+    while ((i < step_cnt) && (step_ticks[i] <= t)) {
+      i++;
+    }
+    *hint = i;
+    if (i == 0) {
+      return 0.0;
+    }
+    if (i == step_cnt) {
+      return step_cnt;
+    }
+    double dt = step_ticks[i] - step_ticks[i - 1];
+    return i + (t - step_ticks[i - 1]) / dt - 1.0;
+  }
+  // returns max. jerk in steps/s³ with sample period h in ticks
+  double max_jerk(uint64_t h) {
+    double hs = h / 16000000.0;
+    uint32_t hint = 0;
+    double p[4] = {0.0, 0.0, 0.0, 0.0};
+    double max_j = 0.0;
+    uint32_t k = 0;
+    // Run one sample period beyond last step to cover the stop
+    for (uint64_t t = 0; t <= curr_ticks + 3 * h; t += h, k++) {
+      p[0] = p[1];
+      p[1] = p[2];
+      p[2] = p[3];
+      p[3] = position_at(t, &hint);
+      if (k >= 3) {
+        double jerk = (p[3] - 3.0 * p[2] + 3.0 * p[1] - p[0]) / (hs * hs * hs);
+        if (fabs(jerk) > max_j) {
+          max_j = fabs(jerk);
+        }
+      }
+    }
+    return max_j;
+  }
+};
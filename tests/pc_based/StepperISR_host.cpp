@@ -0,0 +1,356 @@
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+#include "StepperISR_host.h"
+
+// The steppers of the engine are needed to check for running ramps
+extern FastAccelStepper fas_stepper[MAX_STEPPER];
+
+// Delay from start of a queue to the first compare event as on avr
+#define START_DELAY_TICKS 10
+#define SYNC_START_MARGIN_TICKS 64
+
+// State of the emulated compare unit of each queue
+struct host_queue_s {
+  uint8_t step_pin;
+  // compare interrupt enabled
+  bool active;
+  // output goes high on next compare event
+  bool step_armed;
+  bool prepare_for_stop;
+  // step output is high till step_low
+  bool step_high;
+  uint64_t compare;
+  uint64_t step_low;
+};
+
+static struct host_queue_s host_queue[NUM_QUEUES];
+static struct fas_host_stats_s host_stats;
+static FastAccelStepperEngine* host_engine = NULL;
+static fas_host_edge_cb_t host_edge_cb = NULL;
+static uint64_t host_ticks = 0;
+static uint64_t host_next_manage = FAS_HOST_MANAGE_TICKS;
+static uint8_t host_pin[256];
+
+// Traced pins have an identifier code != 0 in host_vcd_code
+static FILE* host_vcd = NULL;
+static uint64_t host_vcd_ticks;
+static uint8_t host_vcd_signals = 0;
+static uint8_t host_vcd_pin[FAS_HOST_VCD_SIGNALS];
+static const char* host_vcd_name[FAS_HOST_VCD_SIGNALS];
+static char host_vcd_code[256];
+
+static void host_vcd_edge(uint8_t pin, uint8_t level) {
+  if (host_ticks != host_vcd_ticks) {
+    host_vcd_ticks = host_ticks;
+    fprintf(host_vcd, "#%llu\n",
+            (unsigned long long)(host_ticks * FAS_HOST_VCD_PS_PER_TICK));
+  }
+  fprintf(host_vcd, "%d%c\n", level, host_vcd_code[pin]);
+}
+
+static void host_set_pin(uint8_t pin, uint8_t level) {
+  level = level ? 1 : 0;
+  if (host_pin[pin] != level) {
+    host_pin[pin] = level;
+    if (host_vcd && host_vcd_code[pin]) {
+      host_vcd_edge(pin, level);
+    }
+    if (host_edge_cb) {
+      host_edge_cb(host_ticks, pin, level);
+    }
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) { host_set_pin(pin, level); }
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+}
+
+void fas_host_init(FastAccelStepperEngine* engine) {
+  fas_host_vcd_close();
+  for (uint16_t i = 0; i < 256; i++) {
+    host_vcd_code[i] = 0;
+  }
+  host_vcd_signals = 0;
+  host_engine = engine;
+  host_ticks = 0;
+  host_next_manage = FAS_HOST_MANAGE_TICKS;
+  for (uint16_t i = 0; i < 256; i++) {
+    host_pin[i] = 0;
+  }
+  for (uint8_t i = 0; i < NUM_QUEUES; i++) {
+    host_stats.steps[i] = 0;
+    host_stats.stepper_isr_calls[i] = 0;
+  }
+  host_stats.manage_calls = 0;
+}
+void fas_host_set_edge_callback(fas_host_edge_cb_t cb) { host_edge_cb = cb; }
+uint64_t fas_host_ticks() { return host_ticks; }
+uint8_t fas_host_pin_level(uint8_t pin) { return host_pin[pin]; }
+void fas_host_get_stats(struct fas_host_stats_s* stats) {
+  *stats = host_stats;
+}
+
+static void host_step(uint8_t queue_num) {
+  struct host_queue_s* h = &host_queue[queue_num];
+  host_set_pin(h->step_pin, 1);
+  h->step_high = true;
+  h->step_low = host_ticks + FAS_HOST_STEP_HIGH_TICKS;
+  host_stats.steps[queue_num]++;
+}
+
+// Same sequence as AVR_STEPPER_ISR in StepperISR_avr.cpp
+static void host_compare_event(uint8_t queue_num) {
+  StepperQueue* q = &fas_queue[queue_num];
+  struct host_queue_s* h = &host_queue[queue_num];
+  host_stats.stepper_isr_calls[queue_num]++;
+  if (h->step_armed) {
+    host_step(queue_num);
+  }
+  queue_idx_t rp = q->read_idx;
+  if (rp == q->next_write_idx) {
+    // queue is empty => disconnect and disable compare interrupt
+    h->active = false;
+    h->step_armed = false;
+    h->prepare_for_stop = false;
+    q->_isRunning = false;
+    return;
+  }
+  struct queue_entry* e = &q->entry[rp & QUEUE_LEN_MASK];
+  h->compare += e->ticks;
+  if (h->step_armed) {
+    h->step_armed = false;
+    if (e->steps-- > 1) {
+      // perform another step with this queue entry
+      h->step_armed = true;
+      return;
+    }
+  } else if (h->prepare_for_stop) {
+    // new command received after running out of commands
+    h->prepare_for_stop = false;
+    if (e->steps > 0) {
+      host_step(queue_num);
+      if (e->steps-- > 1) {
+        h->step_armed = true;
+        return;
+      }
+    }
+  }
+  if (e->repeat != 0) {
+    e->repeat--;
+    return;
+  }
+  rp++;
+  q->read_idx = rp;
+  if (rp != q->next_write_idx) {
+    e = &q->entry[rp & QUEUE_LEN_MASK];
+    q->_advanceIsrCounters(e);
+    q->_reportMarker(rp);
+    if (e->steps != 0) {
+      h->step_armed = true;
+    }
+    if (e->toggle_dir) {
+      host_set_pin(q->dirPin, !host_pin[q->dirPin]);
+    }
+  } else {
+    h->prepare_for_stop = true;
+  }
+}
+
+void fas_host_run_until(uint64_t end) {
+  while (true) {
+    uint64_t next = host_next_manage;
+    for (uint8_t i = 0; i < NUM_QUEUES; i++) {
+      struct host_queue_s* h = &host_queue[i];
+      if (h->step_high && (h->step_low < next)) {
+        next = h->step_low;
+      }
+      if (h->active && (h->compare < next)) {
+        next = h->compare;
+      }
+    }
+    if (next > end) {
+      break;
+    }
+    host_ticks = next;
+    // falling step edges first, then the stepper ISRs and the cyclic task
+    for (uint8_t i = 0; i < NUM_QUEUES; i++) {
+      struct host_queue_s* h = &host_queue[i];
+      if (h->step_high && (h->step_low == next)) {
+        h->step_high = false;
+        host_set_pin(h->step_pin, 0);
+      }
+    }
+    for (uint8_t i = 0; i < NUM_QUEUES; i++) {
+      struct host_queue_s* h = &host_queue[i];
+      if (h->active && (h->compare == next)) {
+        host_compare_event(i);
+        // the emulated ISR takes no time
+        fas_queue[i]._recordIsrTicks(0);
+      }
+    }
+    if (host_next_manage == next) {
+      host_next_manage += FAS_HOST_MANAGE_TICKS;
+      if (host_engine) {
+        host_stats.manage_calls++;
+        host_engine->manageSteppers();
+      }
+    }
+  }
+  host_ticks = end;
+}
+
+static bool host_is_idle() {
+  for (uint8_t i = 0; i < NUM_QUEUES; i++) {
+    if (host_queue[i].active || host_queue[i].step_high ||
+        !fas_queue[i].isQueueEmpty()) {
+      return false;
+    }
+  }
+  for (uint8_t i = 0; i < MAX_STEPPER; i++) {
+    if (fas_stepper[i].isRampGeneratorActive()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool fas_host_run_until_idle(uint64_t max_ticks) {
+  uint64_t end = host_ticks + max_ticks;
+  while (!host_is_idle()) {
+    if (host_ticks >= end) {
+      return false;
+    }
+    fas_host_run_until(min(host_ticks + FAS_HOST_MANAGE_TICKS, end));
+  }
+  return true;
+}
+
+bool fas_host_vcd_add_signal(uint8_t pin, const char* name) {
+  if (host_vcd || (host_vcd_signals == FAS_HOST_VCD_SIGNALS) ||
+      host_vcd_code[pin]) {
+    return false;
+  }
+  host_vcd_pin[host_vcd_signals] = pin;
+  host_vcd_name[host_vcd_signals] = name;
+  // printable identifier codes start with '!'
+  host_vcd_code[pin] = '!' + host_vcd_signals;
+  host_vcd_signals++;
+  return true;
+}
+
+bool fas_host_vcd_open(const char* filename) {
+  fas_host_vcd_close();
+  host_vcd = fopen(filename, "w");
+  if (!host_vcd) {
+    return false;
+  }
+  fprintf(host_vcd, "$timescale 1ps $end\n$scope module fas_host $end\n");
+  for (uint8_t i = 0; i < host_vcd_signals; i++) {
+    fprintf(host_vcd, "$var wire 1 %c %s $end\n",
+            host_vcd_code[host_vcd_pin[i]], host_vcd_name[i]);
+  }
+  fprintf(host_vcd, "$upscope $end\n$enddefinitions $end\n");
+  host_vcd_ticks = host_ticks;
+  fprintf(host_vcd, "#%llu\n$dumpvars\n",
+          (unsigned long long)(host_ticks * FAS_HOST_VCD_PS_PER_TICK));
+  for (uint8_t i = 0; i < host_vcd_signals; i++) {
+    uint8_t pin = host_vcd_pin[i];
+    fprintf(host_vcd, "%d%c\n", host_pin[pin], host_vcd_code[pin]);
+  }
+  fprintf(host_vcd, "$end\n");
+  return true;
+}
+
+void fas_host_vcd_close() {
+  if (host_vcd) {
+    fclose(host_vcd);
+    host_vcd = NULL;
+  }
+}
+
+//*************************************************************************************************
+// StepperQueue backend
+
+static void host_arm(uint8_t queue_num, uint64_t compare) {
+  StepperQueue* q = &fas_queue[queue_num];
+  struct host_queue_s* h = &host_queue[queue_num];
+  struct queue_entry* e = &q->entry[q->read_idx & QUEUE_LEN_MASK];
+  q->_isRunning = true;
+  h->prepare_for_stop = false;
+  h->step_armed = e->steps > 0;
+  h->active = true;
+  h->compare = compare;
+}
+
+void StepperQueue::init(uint8_t queue_num, uint8_t step_pin) {
+  _initVars();
+  struct host_queue_s* h = &host_queue[queue_num];
+  h->step_pin = step_pin;
+  h->active = false;
+  h->step_armed = false;
+  h->prepare_for_stop = false;
+  h->step_high = false;
+  host_set_pin(step_pin, 0);
+}
+void StepperQueue::commandAddedToQueue(bool start, queue_idx_t n) {
+  queue_idx_t wp = next_write_idx;
+  bool first = (wp == QUEUE_IDX_LOAD(read_idx));
+  QUEUE_IDX_STORE(next_write_idx, wp + n);
+  if (first) {
+    _resetIsrCounters();
+    _reportMarker(read_idx);
+  }
+  if (_isRunning) {
+    return;
+  }
+  if (!first & !start) {
+    return;
+  }
+  struct queue_entry* e = &entry[read_idx & QUEUE_LEN_MASK];
+  if (e->toggle_dir) {
+    host_set_pin(dirPin, !host_pin[dirPin]);
+  }
+  if (start) {
+    host_arm(this - fas_queue, host_ticks + START_DELAY_TICKS);
+  }
+}
+int8_t StepperQueue::startPreparedQueue() {
+  if (isQueueEmpty()) {
+    return AQE_ERROR_EMPTY_QUEUE_TO_START;
+  }
+  host_arm(this - fas_queue, host_ticks + START_DELAY_TICKS);
+  return AQE_OK;
+}
+bool StepperQueue::_isStarted() { return _isRunning; }
+int8_t StepperQueue::startPreparedQueues(uint8_t queue_mask) {
+  int8_t res = _selectQueuesToStart(&queue_mask);
+  if (res != AQE_OK) {
+    return res;
+  }
+  for (uint8_t i = 0; i < NUM_QUEUES; i++) {
+    if (queue_mask & (1 << i)) {
+      host_arm(i, host_ticks + SYNC_START_MARGIN_TICKS);
+    }
+  }
+  return AQE_OK;
+}
+void StepperQueue::forceStop() {
+  struct host_queue_s* h = &host_queue[this - fas_queue];
+  h->active = false;
+  h->step_armed = false;
+  _isRunning = false;
+  QUEUE_IDX_STORE(read_idx, next_write_idx);
+  _resetIsrCounters();
+}
+void StepperQueue::connect() {}
+void StepperQueue::disconnect() {}
+bool StepperQueue::isValidStepPin(uint8_t step_pin) {
+  (void)step_pin;
+  return true;
+}
+int8_t StepperQueue::queueNumForStepPin(uint8_t step_pin) {
+  (void)step_pin;
+  return -1;
+}
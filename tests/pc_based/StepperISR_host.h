@@ -0,0 +1,59 @@
+#ifndef STEPPERISR_HOST_H
+#define STEPPERISR_HOST_H
+#include <stdint.h>
+
+#include "FastAccelStepper.h"
+
+// Virtual time backend for host tests. It replaces StepperISR_test.cpp and
+// executes the command queues like the avr stepper ISR does: a step is
+// output on the compare event and the next compare event is ticks later.
+// In addition manageSteppers() of the engine is called every 4ms, like the
+// cyclic task on esp32. StepperISR.h has to be included before.
+//
+// Time advances only within fas_host_run_until(), so any sequence of API
+// calls between two runs happens at the same tick. Stepper ISRs and the
+// cyclic task do not preempt each other.
+
+// Period of the cyclic task
+#define FAS_HOST_MANAGE_TICKS (TICKS_PER_S / 250)
+// High time of the step pulse
+#define FAS_HOST_STEP_HIGH_TICKS (TICKS_PER_S / 1000000 * 3)
+
+// Called for every level change of any pin with the tick of the change.
+// Edges are reported in time order
+typedef void (*fas_host_edge_cb_t)(uint64_t ticks, uint8_t pin,
+                                   uint8_t level);
+
+struct fas_host_stats_s {
+  uint32_t steps[NUM_QUEUES];
+  uint32_t stepper_isr_calls[NUM_QUEUES];
+  uint32_t manage_calls;
+};
+
+// Reset time, pin levels and statistics. engine can be NULL, if the test
+// calls fill_queue() by itself
+void fas_host_init(FastAccelStepperEngine* engine);
+void fas_host_set_edge_callback(fas_host_edge_cb_t cb);
+uint64_t fas_host_ticks();
+uint8_t fas_host_pin_level(uint8_t pin);
+void fas_host_get_stats(struct fas_host_stats_s* stats);
+
+// Execute all events up to and including the tick end
+void fas_host_run_until(uint64_t end);
+// Run until all queues are empty and the ramp generators of the steppers
+// connected by the engine are idle. Returns false, if this is not reached
+// within max_ticks
+bool fas_host_run_until_idle(uint64_t max_ticks);
+
+// VCD trace of selected pins like the traces of the simavr tests, so a host
+// run can be evaluated by tests/simavr_based/eval.awk with -v REF=
+// FAS_HOST_VCD_REF and viewed with GTKWave. Signals are added before the
+// trace is opened. fas_host_init() closes the trace and removes the signals
+#define FAS_HOST_VCD_SIGNALS 16
+#define FAS_HOST_VCD_PS_PER_TICK (1000000000000LL / TICKS_PER_S)
+// VCD time units per us
+#define FAS_HOST_VCD_REF 1000000
+bool fas_host_vcd_add_signal(uint8_t pin, const char* name);
+bool fas_host_vcd_open(const char* filename);
+void fas_host_vcd_close();
+#endif
@@ -5,13 +5,57 @@
 // Here are the global variables to interface with the interrupts
 // StepperQueue fas_queue[NUM_QUEUES];
 
-void StepperQueue::init(uint8_t queue_num, uint8_t step_pin) { _initVars(); }
-void StepperQueue::commandAddedToQueue(bool start) {
+void digitalWrite(uint8_t pin, uint8_t level) {}
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+// The esp32 backend applies the first command of a prepared queue, so
+// isRunning() is true before the queue is started. Tests can select this
+// behaviour with fas_test_prepared_is_running
+bool fas_test_prepared_is_running = false;
+static bool test_started[NUM_QUEUES];
+
+void StepperQueue::init(uint8_t queue_num, uint8_t step_pin) {
+  _initVars();
+  test_started[queue_num] = false;
+}
+void StepperQueue::commandAddedToQueue(bool start, queue_idx_t n) {
   _isRunning = start;
-  next_write_idx++;
+  test_started[this - fas_queue] = start;
+  queue_idx_t wp = next_write_idx;
+  bool first = (wp == QUEUE_IDX_LOAD(read_idx));
+  QUEUE_IDX_STORE(next_write_idx, wp + n);
+  if (first) {
+    _resetIsrCounters();
+    _reportMarker(read_idx);
+  }
+  if (fas_test_prepared_is_running) {
+    _isRunning = true;
+  }
+}
+bool StepperQueue::_isStarted() { return test_started[this - fas_queue]; }
+int8_t StepperQueue::startPreparedQueue() {
+  test_started[this - fas_queue] = true;
+  return AQE_OK;
+}
+int8_t StepperQueue::startPreparedQueues(uint8_t queue_mask) {
+  int8_t res = _selectQueuesToStart(&queue_mask);
+  if (res != AQE_OK) {
+    return res;
+  }
+  for (uint8_t i = 0; i < NUM_QUEUES; i++) {
+    if (queue_mask & (1 << i)) {
+      fas_queue[i]._isRunning = true;
+      test_started[i] = true;
+    }
+  }
+  return AQE_OK;
+}
+void StepperQueue::forceStop() {
+  _isRunning = false;
+  test_started[this - fas_queue] = false;
+  QUEUE_IDX_STORE(read_idx, next_write_idx);
+  _resetIsrCounters();
 }
-int8_t StepperQueue::startPreparedQueue() { return AQE_OK; }
-void StepperQueue::forceStop() {}
 void StepperQueue::connect() {}
 void StepperQueue::disconnect() {}
 bool StepperQueue::isValidStepPin(uint8_t step_pin) { return true; }
@@ -0,0 +1,281 @@
+// Host micro benchmarks of the ramp calculation with machine readable output.
+//
+// Each benchmark is executed for at least 100ms on fixed input values. The
+// result is printed as one CSV line per benchmark:
+//
+//	variant,group,name,calls,ns_per_call,cycles_per_call
+//
+// variant is upm (micro_bench), table (micro_bench_rt) or fixed
+// (micro_bench_fx) as for ramp_bench. group is one of:
+//	calc  - calculate_ticks_v8()/fixed point/ramp table lookup
+//	upm   - the upm_* functions of PoorManFloat
+//	ramp  - RampGenerator::getNextCommand() by ramp state of the command
+//	fill  - fill_queue() of N steppers per 4ms cycle. Reported per fill
+//	        cycle of all steppers and per generated command
+//
+// calculate_ticks_v9() is not benchmarked: apart from a debug printf it is
+// identical to calculate_ticks_v8() and only compiled for TEST.
+//
+// Run with:
+//	make bench
+// or store the results for comparison between commits:
+//	make micro_bench && ./micro_bench > bench_$(git rev-parse --short HEAD).csv
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "FastAccelStepper.h"
+#include "RampCalculator.h"
+#include "RampGenerator.h"
+#include "StepperISR.h"
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void noInterrupts() {}
+void interrupts() {}
+
+#define MIN_RUN_NS 100000000ULL
+#define INPUTS 256
+
+#if (FAS_RAMP_TABLE == 1)
+static const char *variant = "table";
+#elif (FAS_RAMP_MATH_FIXED == 1)
+static const char *variant = "fixed";
+#else
+static const char *variant = "upm";
+#endif
+
+static inline uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline uint64_t cycles() { return __builtin_ia32_rdtsc(); }
+#else
+static inline uint64_t cycles() { return 0; }
+#endif
+
+static void report(const char *group, const char *name, uint64_t calls,
+                   uint64_t dt, uint64_t dc) {
+  double ns = calls ? (double)dt / calls : 0.0;
+  double c = calls ? (double)dc / calls : 0.0;
+  printf("%s,%s,%s,%llu,%.2f,%.1f\n", variant, group, name,
+         (unsigned long long)calls, ns, c);
+}
+
+// Fixed pseudo random input values for reproducible runs
+static uint32_t lcg_state = 12345;
+static uint32_t lcg() {
+  lcg_state = lcg_state * 1103515245 + 12345;
+  return lcg_state >> 8;
+}
+
+static uint32_t in_steps[INPUTS];
+static upm_float in_upm[INPUTS];
+static upm_float in_upm2[INPUTS];
+static uint32_t in_u32[INPUTS];
+static volatile uint32_t sink;
+
+static void init_inputs() {
+  for (uint16_t i = 0; i < INPUTS; i++) {
+    // ramp steps distributed over 1..2^24 in log scale
+    in_steps[i] = 1 + (lcg() >> (lcg() % 24));
+    in_u32[i] = lcg();
+    in_upm[i] = upm_from(in_u32[i]);
+    in_upm2[i] = upm_from((uint32_t)(lcg() & 0xffff) + 1);
+  }
+}
+
+// Calls the expression with i = input index till MIN_RUN_NS are over
+#define BENCH(group, name, expr)                                 \
+  {                                                              \
+    uint64_t calls = 0;                                          \
+    uint32_t acc = 0;                                            \
+    uint64_t t_start = now_ns();                                 \
+    uint64_t c_start = cycles();                                 \
+    while (now_ns() - t_start < MIN_RUN_NS) {                    \
+      for (uint16_t i = 0; i < INPUTS; i++) {                    \
+        acc += (expr);                                           \
+      }                                                          \
+      calls += INPUTS;                                           \
+    }                                                            \
+    uint64_t dc = cycles() - c_start;                            \
+    report(group, name, calls, now_ns() - t_start, dc);          \
+    sink = acc;                                                  \
+  }
+
+static void bench_calc() {
+  upm_float pre_calc = upm_from((uint32_t)16000000 / 447);
+  BENCH("calc", "calculate_ticks_v8",
+        calculate_ticks_v8(in_steps[i], pre_calc));
+  uint32_t sqrt_inv_accel = calculate_sqrt_inv_accel_fixed(TICKS_PER_S, 1000);
+  BENCH("calc", "calculate_ticks_fixed",
+        calculate_ticks_fixed(in_steps[i], sqrt_inv_accel));
+  BENCH("calc", "calculate_ramp_steps_fixed",
+        calculate_ramp_steps_fixed(in_u32[i] & 0xffff, sqrt_inv_accel));
+  RampTable table;
+  table.init();
+  table.build(pre_calc);
+  BENCH("calc", "RampTable::ticks", table.ticks(in_steps[i], pre_calc));
+}
+
+static void bench_upm() {
+  BENCH("upm", "upm_from_u8", upm_from((uint8_t)in_u32[i]));
+  BENCH("upm", "upm_from_u16", upm_from((uint16_t)in_u32[i]));
+  BENCH("upm", "upm_from_u32", upm_from(in_u32[i]));
+  BENCH("upm", "upm_to_u16", upm_to_u16(in_upm2[i]));
+  BENCH("upm", "upm_to_u32", upm_to_u32(in_upm[i]));
+  BENCH("upm", "upm_shl", upm_shl(in_upm[i], 3));
+  BENCH("upm", "upm_shr", upm_shr(in_upm[i], 3));
+  BENCH("upm", "upm_multiply", upm_multiply(in_upm[i], in_upm2[i]));
+  BENCH("upm", "upm_reciprocal", upm_reciprocal(in_upm[i]));
+  BENCH("upm", "upm_square", upm_square(in_upm2[i]));
+  BENCH("upm", "upm_rsquare", upm_rsquare(in_upm2[i]));
+  BENCH("upm", "upm_rsqrt", upm_rsqrt(in_upm[i]));
+  BENCH("upm", "upm_cbrt", upm_cbrt(in_upm[i]));
+  BENCH("upm", "upm_divide", upm_divide(in_upm[i], in_upm2[i]));
+}
+
+// getNextCommand() of moves, which are reversed during coasting. Each call
+// is measured and accounted to the ramp state of the command.
+#define STATES 4
+static const uint8_t states[STATES] = {RAMP_STATE_ACCELERATE, RAMP_STATE_COAST,
+                                       RAMP_STATE_DECELERATE,
+                                       RAMP_STATE_REVERSE};
+static const char *state_names[STATES] = {"accelerate", "coast", "decelerate",
+                                          "reverse"};
+
+static void bench_ramp() {
+  uint64_t calls[STATES] = {0};
+  uint64_t dc[STATES] = {0};
+  RampGenerator rg;
+  struct queue_end_s queue_end;
+  queue_end.pos = 0;
+  queue_end.count_up = true;
+  queue_end.dir = true;
+  rg.init();
+  rg.setSpeedInUs(20);
+  rg.setAcceleration(1000000);
+  rg.applySpeedAcceleration();
+  uint64_t t_start = now_ns();
+  uint64_t c_run = cycles();
+  while (now_ns() - t_start < MIN_RUN_NS) {
+    int32_t start = queue_end.pos;
+    rg.moveTo(start > 0 ? -20000 : 20000, &queue_end);
+    bool reversed = false;
+    NextCommand cmd;
+    while (true) {
+      uint64_t c_start = cycles();
+      rg.getNextCommand(&queue_end, &cmd);
+      uint64_t c = cycles() - c_start;
+      if (cmd.command.ticks == 0) {
+        break;
+      }
+      uint8_t state = cmd.rw.ramp_state & RAMP_STATE_MASK;
+      for (uint8_t i = 0; i < STATES; i++) {
+        if (states[i] == state) {
+          calls[i]++;
+          dc[i] += c;
+        }
+      }
+      rg.afterCommandEnqueued(&cmd);
+      queue_end.pos += cmd.command.count_up ? (int32_t)cmd.command.steps
+                                            : -(int32_t)cmd.command.steps;
+      queue_end.count_up = cmd.command.count_up;
+      // reverse during coasting and return to start
+      if (!reversed && (state == RAMP_STATE_COAST) &&
+          (abs(queue_end.pos - start) > 15000)) {
+        rg.moveTo(start, &queue_end);
+        reversed = true;
+      }
+    }
+  }
+  c_run = cycles() - c_run;
+  uint64_t dt = now_ns() - t_start;
+  // Single calls are measured in cycles only
+  double ns_per_cycle = c_run ? (double)dt / c_run : 0;
+  for (uint8_t i = 0; i < STATES; i++) {
+    char name[40];
+    snprintf(name, sizeof(name), "getNextCommand_%s", state_names[i]);
+    report("ramp", name, calls[i], (uint64_t)(dc[i] * ns_per_cycle), dc[i]);
+  }
+}
+
+// fill_queue() for n steppers called every 4ms. The emulated ISR consumes
+// 4ms of commands of each queue before the next fill cycle.
+#define FILL_CYCLE_TICKS (TICKS_PER_S / 250)
+class FastAccelStepperTest {
+ public:
+  FastAccelStepper s[NUM_QUEUES];
+
+  void consume(uint8_t q_num) {
+    StepperQueue *q = &fas_queue[q_num];
+    uint32_t ticks = 0;
+    while (!q->isQueueEmpty() && (ticks < FILL_CYCLE_TICKS)) {
+      struct queue_entry *e = &q->entry[q->read_idx & QUEUE_LEN_MASK];
+      ticks += (uint32_t)e->ticks * (e->steps ? e->steps : 1);
+      q->read_idx++;
+    }
+  }
+
+  void bench_fill(uint8_t n) {
+    for (uint8_t i = 0; i < n; i++) {
+      fas_queue[i].read_idx = 0;
+      fas_queue[i].next_write_idx = 0;
+      s[i] = FastAccelStepper();
+      s[i].init(NULL, i, i);
+      s[i].setDirectionPin(10 + i);
+      s[i].setSpeedInUs(20 + 10 * i);
+      s[i].setAcceleration(50000);
+    }
+    uint64_t fills = 0;
+    uint64_t commands = 0;
+    uint64_t dt = 0;
+    uint64_t dc = 0;
+    uint32_t repeat = 0;
+    while (dt < MIN_RUN_NS) {
+      for (uint8_t i = 0; i < n; i++) {
+        if (!s[i].isRampGeneratorActive()) {
+          s[i].moveTo((repeat & 1) ? 0 : 50000);
+        }
+      }
+      queue_idx_t written[NUM_QUEUES];
+      for (uint8_t i = 0; i < n; i++) {
+        written[i] = fas_queue[i].next_write_idx;
+      }
+      uint64_t t_start = now_ns();
+      uint64_t c_start = cycles();
+      for (uint8_t i = 0; i < n; i++) {
+        s[i].fill_queue();
+      }
+      dc += cycles() - c_start;
+      dt += now_ns() - t_start;
+      fills++;
+      for (uint8_t i = 0; i < n; i++) {
+        commands += (queue_idx_t)(fas_queue[i].next_write_idx - written[i]);
+        consume(i);
+      }
+      repeat++;
+    }
+    char name[40];
+    snprintf(name, sizeof(name), "fill_queue_%u_steppers", n);
+    report("fill", name, fills, dt, dc);
+    snprintf(name, sizeof(name), "fill_queue_%u_steppers_per_command", n);
+    report("fill", name, commands, dt, dc);
+  }
+};
+
+int main() {
+  init_inputs();
+  printf("variant,group,name,calls,ns_per_call,cycles_per_call\n");
+  bench_calc();
+  bench_upm();
+  bench_ramp();
+  FastAccelStepperTest test;
+  for (uint8_t n = 1; n <= NUM_QUEUES; n++) {
+    test.bench_fill(n);
+  }
+  return 0;
+}
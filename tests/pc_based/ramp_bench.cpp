@@ -0,0 +1,107 @@
+// Host benchmark for the ramp generation as used by fill_queue().
+//
+// The RampGenerator is compiled without TEST (no printf) and with -O2.
+// Same source is linked three times: ramp_bench uses the upm based
+// calculation, ramp_bench_rt is compiled with -DFAS_RAMP_TABLE=1 and
+// ramp_bench_fx with -DFAS_RAMP_MATH_FIXED=1.
+//
+// Run with:
+//	make bench
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "FastAccelStepper.h"
+#include "RampGenerator.h"
+
+void noInterrupts() {}
+void interrupts() {}
+
+static inline uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline uint64_t cycles() { return __builtin_ia32_rdtsc(); }
+#else
+static inline uint64_t cycles() { return 0; }
+#endif
+
+// Returns number of generated commands for one complete move
+static uint32_t run_move(RampGenerator *rg, struct queue_end_s *queue_end,
+                         int32_t target) {
+  rg->moveTo(target, queue_end);
+  uint32_t commands = 0;
+  NextCommand cmd;
+  while (true) {
+    rg->getNextCommand(queue_end, &cmd);
+    if (cmd.command.ticks == 0) {
+      break;
+    }
+    rg->afterCommandEnqueued(&cmd);
+    if (cmd.command.count_up) {
+      queue_end->pos += cmd.command.steps;
+    } else {
+      queue_end->pos -= cmd.command.steps;
+    }
+    queue_end->count_up = cmd.command.count_up;
+    commands++;
+  }
+  return commands;
+}
+
+struct bench_case_s {
+  const char *name;
+  uint32_t speed_us;
+  int32_t accel;
+  int32_t steps;
+};
+
+static const struct bench_case_s cases[] = {
+    {"slow_short", 1000, 1000, 1000},
+    {"medium", 100, 10000, 10000},
+    {"fast_long", 20, 100000, 200000},
+    {"fast_high_accel", 20, 1000000, 100000},
+};
+
+int main() {
+#if (FAS_RAMP_TABLE == 1)
+  const char *variant = "table";
+#elif (FAS_RAMP_MATH_FIXED == 1)
+  const char *variant = "fixed";
+#else
+  const char *variant = "upm";
+#endif
+  RampGenerator rg;
+  for (uint8_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    const struct bench_case_s *c = &cases[i];
+    struct queue_end_s queue_end;
+    queue_end.pos = 0;
+    queue_end.count_up = true;
+    queue_end.dir = true;
+    rg.init();
+    rg.setSpeedInUs(c->speed_us);
+    rg.setAcceleration(c->accel);
+    rg.applySpeedAcceleration();
+    uint32_t commands = 0;
+    uint32_t repeat = 0;
+    uint64_t t_start = now_ns();
+    uint64_t c_start = cycles();
+    // Run for at least 200ms
+    while (now_ns() - t_start < 200000000ULL) {
+      // move forth and back
+      int32_t target = (repeat & 1) ? 0 : c->steps;
+      commands += run_move(&rg, &queue_end, target);
+      repeat++;
+    }
+    uint64_t dc = cycles() - c_start;
+    uint64_t dt = now_ns() - t_start;
+    printf("%-6s %-16s commands/move=%-6u ns/command=%7.2f "
+           "cycles/command=%7.1f\n",
+           variant, c->name, commands / repeat, (double)dt / commands,
+           (double)dc / commands);
+  }
+  return 0;
+}
@@ -15,15 +15,17 @@ void inject_fill_interrupt(int mark);
 #define micros() 0
 
 #include <math.h>
+#include <stdint.h>
 
 #define abs(x) ((x) > 0 ? (x) : -(x))
 #define min(a, b) ((a) > (b) ? (b) : (a))
 #define max(a, b) ((a) > (b) ? (a) : (b))
 
-#define digitalWrite(a, b) \
-  {}
-#define pinMode(a, b) \
-  {}
+// Pin accesses of the library. StepperISR_test.cpp ignores them and the
+// virtual time backend StepperISR_host.cpp records the levels
+#define OUTPUT 1
+void digitalWrite(uint8_t pin, uint8_t level);
+void pinMode(uint8_t pin, uint8_t mode);
 
 extern char TCCR1A;
 extern char TCCR1B;
@@ -61,7 +61,7 @@ class FastAccelStepperTest {
       while (!s.isQueueEmpty()) {
         rc.check_section(
             &fas_queue_A.entry[fas_queue[0].read_idx & QUEUE_LEN_MASK]);
-        fas_queue[0].read_idx++;
+        fas_queue[0]._testNextCommand();
       }
     }
     test(!s.isRampGeneratorActive(), "too many commands created");
@@ -126,7 +126,7 @@ class FastAccelStepperTest {
       while (!s.isQueueEmpty()) {
         rc.check_section(
             &fas_queue_A.entry[fas_queue[0].read_idx & QUEUE_LEN_MASK]);
-        fas_queue[0].read_idx++;
+        fas_queue[0]._testNextCommand();
         fprintf(gp_file, "%.6f %.2f %d\n", rc.total_ticks / 1000000.0,
                 16000000.0 / rc.last_dt, rc.last_dt);
       }
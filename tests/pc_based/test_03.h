@@ -185,6 +185,31 @@ bool perform_test() {
     }
   }
 
+  // Check cubic root
+  for (int16_t sa = -30; sa <= 30; sa++) {
+    for (uint32_t a_32 = 1; a_32 <= 0x1ff; a_32++) {
+      x1 = upm_from(a_32);
+      if (sa > 0) {
+        x1 = upm_shl(x1, sa);
+      } else if (sa < 0) {
+        x1 = upm_shr(x1, -sa);
+      }
+      x = upm_cbrt(x1);
+
+      upm_float xe = upm_divide(upm_multiply(x, upm_square(x)), x1);
+      // xe should be approximately 1
+      uint32_t res = upm_to_u32(upm_shl(xe, 16));
+      int32_t diff = (int32_t)res - 0x10000;
+      if (abs(diff) > 1024) {
+        xprintf("a=%d upm(x)=%x  upm(cbrt(x))=%x upm(cbrt(x)^3/x)=%x ", a_32,
+                x1, x, xe);
+        xprintf("shift=%d cbrt(%d)^3/%d*0x10000=%x, diff=%d\n", sa, a_32, a_32,
+                res, diff);
+      }
+      test(abs(diff) <= 1024, "cbrt error");
+    }
+  }
+
   x1 = upm_from((uint32_t)0x0ffff);
   x2 = upm_from((uint32_t)0x1fffe);
   x2 = upm_from((uint32_t)0x10100);
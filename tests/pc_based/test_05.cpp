@@ -81,7 +81,7 @@ class FastAccelStepperTest {
       while (!s.isQueueEmpty()) {
         rc.check_section(
             &fas_queue[0].entry[fas_queue[0].read_idx & QUEUE_LEN_MASK]);
-        fas_queue[0].read_idx++;
+        fas_queue[0]._testNextCommand();
       }
       in_manage = false;
       uint32_t to_dt = rc.total_ticks;
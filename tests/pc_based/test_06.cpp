@@ -85,7 +85,7 @@ class FastAccelStepperTest {
       while (!s.isQueueEmpty()) {
         rc.check_section(
             &fas_queue[0].entry[fas_queue[0].read_idx & QUEUE_LEN_MASK]);
-        fas_queue[0].read_idx++;
+        fas_queue[0]._testNextCommand();
       }
       uint32_t to_dt = rc.total_ticks;
       float planned_time = (to_dt - from_dt) * 1.0 / 16000000;
@@ -147,7 +147,7 @@ class FastAccelStepperTest {
         while (!s.isQueueEmpty()) {
           rc.check_section(
               &fas_queue[0].entry[fas_queue[0].read_idx & QUEUE_LEN_MASK]);
-          fas_queue[0].read_idx++;
+          fas_queue[0]._testNextCommand();
         }
         uint32_t to_dt = rc.total_ticks;
         float planned_time = (to_dt - from_dt) * 1.0 / 16000000;
@@ -70,7 +70,7 @@ class FastAccelStepperTest {
           rc.decrease_ok = true;
           rc.check_section(
               &fas_queue[0].entry[fas_queue[0].read_idx & QUEUE_LEN_MASK]);
-          fas_queue[0].read_idx++;
+          fas_queue[0]._testNextCommand();
           fprintf(gp_file, "%.6f %.2f %d\n", rc.total_ticks / 1000000.0,
                   16000000.0 / rc.last_dt, rc.last_dt);
         }
@@ -0,0 +1,118 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+#include "RampChecker.h"
+
+class FastAccelStepperTest {
+ public:
+  // step period at max. speed of the last ramp
+  uint32_t min_dt;
+
+  void init_queue() {
+    fas_queue[0].read_idx = 0;
+    fas_queue[1].read_idx = 0;
+    fas_queue[0].next_write_idx = 0;
+    fas_queue[1].next_write_idx = 0;
+  }
+
+  // returns max jerk in steps/s³ evaluated with 50ms sample period
+  double ramp(const char *name, int32_t steps, uint32_t speed_us,
+              uint32_t accel, uint32_t jerk) {
+    printf("Test %s steps=%d speed=%dus accel=%d jerk=%d\n", name, steps,
+           speed_us, accel, jerk);
+    init_queue();
+    FastAccelStepper s = FastAccelStepper();
+    s.init(NULL, 0, 0);
+    JerkChecker rc = JerkChecker();
+    assert(0 == s.getCurrentPosition());
+
+    assert(s.isQueueEmpty());
+    s.setSpeedInUs(speed_us);
+    s.setAcceleration(accel);
+    s.setJerk(jerk);
+    assert(s.getJerk() == jerk);
+    s.move(steps);
+    s.fill_queue();
+    assert(!s.isQueueEmpty());
+    float old_planned_time_in_buffer = 0;
+
+    char fname[100];
+    sprintf(fname, "test_11_%s.gnuplot", name);
+    FILE *gp_file = fopen(fname, "w");
+    fprintf(gp_file, "$data <<EOF\n");
+    for (int i = 0; i < steps; i++) {
+      if (!s.isRampGeneratorActive()) {
+        break;
+      }
+      s.fill_queue();
+      uint32_t from_dt = rc.total_ticks;
+      while (!s.isQueueEmpty()) {
+        rc.check_section(
+            &fas_queue[0].entry[fas_queue[0].read_idx & QUEUE_LEN_MASK]);
+        fas_queue[0]._testNextCommand();
+        fprintf(gp_file, "%.6f %.2f %d\n", rc.total_ticks / 16000000.0,
+                16000000.0 / rc.last_dt, rc.last_dt);
+      }
+      uint32_t to_dt = rc.total_ticks;
+      float planned_time = (to_dt - from_dt) * 1.0 / 16000000;
+      // This must be ensured, so that the stepper does not run out of
+      // commands
+      assert((i == 0) || (old_planned_time_in_buffer > 0.005));
+      old_planned_time_in_buffer = planned_time;
+    }
+    fprintf(gp_file, "EOF\n");
+    fprintf(gp_file, "plot $data using 1:2 with linespoints\n");
+    fprintf(gp_file, "pause -1\n");
+    fclose(gp_file);
+    test(!s.isRampGeneratorActive(), "too many commands created");
+    test(s.getCurrentPosition() == steps, "has not reached target position");
+    min_dt = rc.min_dt;
+    double max_jerk = rc.max_jerk(16000000 / 20);
+    printf("Total time %f, max jerk %.0f\n", rc.total_ticks / 16000000.0,
+           max_jerk);
+    return max_jerk;
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  double trapezoid = test.ramp("f1", 100000, 50, 20000, 0);
+  test(test.min_dt == 50 * 16, "max speed not reached");
+  test(trapezoid > 200000.0, "trapezoidal ramp should have high jerk");
+  double scurve = test.ramp("f2", 100000, 50, 20000, 50000);
+  test(test.min_dt == 50 * 16, "max speed not reached");
+  test(scurve < 1.5 * 50000, "jerk limit exceeded");
+  scurve = test.ramp("f3", 40000, 100, 5000, 20000);
+  test(test.min_dt == 100 * 16, "max speed not reached");
+  test(scurve < 1.5 * 20000, "jerk limit exceeded");
+  // Short and mid-length moves do not reach the max. speed and the
+  // acceleration is reduced to sqrt(v*j)
+  scurve = test.ramp("f4", 2000, 50, 20000, 50000);
+  test(scurve < 1.15 * 50000, "jerk limit exceeded on short move");
+  scurve = test.ramp("f5", 8000, 50, 20000, 50000);
+  test(scurve < 1.15 * 50000, "jerk limit exceeded on mid-length move");
+  // The max. speed is too low to reach the acceleration
+  scurve = test.ramp("f6", 40000, 500, 20000, 50000);
+  test(test.min_dt == 500 * 16, "max speed not reached");
+  test(scurve < 1.15 * 50000, "jerk limit exceeded at low speed");
+  printf("TEST_11 PASSED\n");
+  return 0;
+}
@@ -0,0 +1,155 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <thread>
+
+#include "FastAccelStepper.h"
+#include "RampCalculator.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+// Compare RampTable against calculate_ticks_v8() and the exact formula
+//	ticks = TICKS_PER_S / sqrt(2 * accel * steps)
+static void check_table(uint32_t accel) {
+  printf("Check ramp table for acceleration=%u\n", accel);
+  upm_float pre_calc = upm_multiply(upm_rsqrt(upm_from(accel)),
+                                    UPM_TICKS_PER_S_DIV_SQRT_OF_2);
+  RampTable table;
+  table.init();
+  test(!table.isValidFor(pre_calc), "table must be invalid after init");
+  table.build(pre_calc);
+  test(table.isValidFor(pre_calc), "table must be valid after build");
+  test(!table.isValidFor(upm_shl(pre_calc, 1)),
+       "table must be invalid for other acceleration");
+
+  float max_err_v8 = 0.0;
+  float max_err_exact = 0.0;
+  uint32_t hits = 0;
+  for (uint32_t steps = 1; steps < ((uint32_t)1 << (RAMP_TABLE_OCTAVES + 1));
+       steps += 1 + steps / 64) {
+    uint32_t ticks = table.ticks(steps, pre_calc);
+    uint32_t ticks_v8 = calculate_ticks_v8(steps, pre_calc);
+    if (steps >= ((uint32_t)1 << RAMP_TABLE_OCTAVES)) {
+      test(ticks == 0, "steps beyond table must return 0");
+      continue;
+    }
+    if (ticks == 0) {
+      // only allowed, if the value cannot be stored in the table
+      test(ticks_v8 > 60000, "unexpected table miss");
+      continue;
+    }
+    hits++;
+    float exact = TICKS_PER_S / sqrt(2.0 * accel * steps);
+    float err_v8 = fabs((float)ticks - ticks_v8) / ticks_v8;
+    float err_exact = fabs((float)ticks - exact) / exact;
+    if (err_v8 > max_err_v8) {
+      max_err_v8 = err_v8;
+    }
+    if (err_exact > max_err_exact) {
+      max_err_exact = err_exact;
+    }
+    // allow one tick deviation for small tick values
+    if (abs((int32_t)ticks - (int32_t)ticks_v8) > 1) {
+      test(err_v8 < 0.02, "too much deviation to calculate_ticks_v8");
+      test(err_exact < 0.015, "too much deviation to exact value");
+    }
+  }
+  printf("  %u lookups: max error to v8=%.4f, to exact=%.4f\n", hits,
+         max_err_v8, max_err_exact);
+  test(hits > 0, "table not used at all");
+}
+
+// On esp32 the table is rebuilt by setAcceleration() in the application task,
+// while fill_queue() reads it on the other core. The builder thread
+// alternates between two accelerations and the reader thread checks, that
+// every lookup is either a miss or the value of a complete table for the
+// requested acceleration.
+#define REBUILDS 20000
+
+static RampTable shared_table;
+static volatile bool builder_done;
+
+static void builder(upm_float pre_a, upm_float pre_b) {
+  for (uint32_t i = 0; i < REBUILDS; i++) {
+    shared_table.build((i & 1) ? pre_b : pre_a);
+    // let the reader see the valid tables, too
+    if ((i & 7) == 0) {
+      std::this_thread::yield();
+    }
+  }
+  builder_done = true;
+}
+
+static void reader(upm_float pre_a, const RampTable *ref_a, upm_float pre_b,
+                   const RampTable *ref_b) {
+  uint32_t lookups = 0;
+  uint32_t misses = 0;
+  uint32_t steps = 1;
+  while (!builder_done) {
+    if ((lookups & 63) == 0) {
+      std::this_thread::yield();
+    }
+    bool use_b = (lookups & 1) != 0;
+    upm_float pre_calc = use_b ? pre_b : pre_a;
+    const RampTable *ref = use_b ? ref_b : ref_a;
+    uint32_t ticks = shared_table.ticks(steps, pre_calc);
+    if (ticks == 0) {
+      misses++;
+    } else {
+      test(ticks == ref->ticks(steps, pre_calc), "inconsistent ramp table");
+    }
+    lookups++;
+    steps = (steps * 3 + 7) & 0x7ffff;
+  }
+  printf("reader: %u lookups, %u misses\n", lookups, misses);
+  test(misses < lookups, "no valid lookups");
+}
+
+static void check_concurrent_build() {
+  puts("Check ramp table rebuild during lookups");
+  upm_float pre_a = upm_multiply(upm_rsqrt(upm_from((uint32_t)10000)),
+                                 UPM_TICKS_PER_S_DIV_SQRT_OF_2);
+  upm_float pre_b = upm_multiply(upm_rsqrt(upm_from((uint32_t)1000000)),
+                                 UPM_TICKS_PER_S_DIV_SQRT_OF_2);
+  RampTable ref_a, ref_b;
+  ref_a.init();
+  ref_a.build(pre_a);
+  ref_b.init();
+  ref_b.build(pre_b);
+  shared_table.init();
+  test(shared_table.ticks(1000, pre_a) == 0, "ticks() of table without build");
+  builder_done = false;
+
+  std::thread r(reader, pre_a, &ref_a, pre_b, &ref_b);
+  std::thread b(builder, pre_a, pre_b);
+  b.join();
+  r.join();
+  // REBUILDS is even, so pre_b has been built last
+  test(shared_table.isValidFor(pre_b), "table invalid after rebuilds");
+  test(shared_table.ticks(1000, pre_a) == 0, "lookup for other acceleration");
+}
+
+int main() {
+  check_table(1);
+  check_table(100);
+  check_table(10000);
+  check_table(1000000);
+  check_table(100000000);
+  check_concurrent_build();
+  printf("TEST_12 PASSED\n");
+  return 0;
+}
@@ -0,0 +1,160 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+#include "RampChecker.h"
+
+class FastAccelStepperTest {
+ public:
+  void init_queue() {
+    fas_queue[0].read_idx = 0;
+    fas_queue[1].read_idx = 0;
+    fas_queue[0].next_write_idx = 0;
+    fas_queue[1].next_write_idx = 0;
+  }
+
+  // returns total time of the move in s
+  float ramp(const char *name, int32_t steps, uint32_t speed_us,
+             uint32_t accel, uint32_t decel) {
+    printf("Test %s steps=%d speed=%dus accel=%d decel=%d\n", name, steps,
+           speed_us, accel, decel);
+    init_queue();
+    FastAccelStepper s = FastAccelStepper();
+    s.init(NULL, 0, 0);
+    RampChecker rc = RampChecker();
+    assert(0 == s.getCurrentPosition());
+
+    assert(s.isQueueEmpty());
+    s.setSpeedInUs(speed_us);
+    s.setAcceleration(accel);
+    test(s.setDeceleration(decel) == 0, "deceleration not accepted");
+    test(s.getDeceleration() == (decel == 0 ? accel : decel),
+         "wrong deceleration");
+    s.move(steps);
+    s.fill_queue();
+    assert(!s.isQueueEmpty());
+    float old_planned_time_in_buffer = 0;
+    bool seen_decel = false;
+
+    char fname[100];
+    sprintf(fname, "test_13_%s.gnuplot", name);
+    FILE *gp_file = fopen(fname, "w");
+    fprintf(gp_file, "$data <<EOF\n");
+    for (int i = 0; i < steps; i++) {
+      if (!s.isRampGeneratorActive()) {
+        break;
+      }
+      if (s.getCurrentAcceleration() < 0) {
+        seen_decel = true;
+        test(s.getCurrentAcceleration() == -(int32_t)s.getDeceleration(),
+             "wrong current acceleration on deceleration");
+      }
+      s.fill_queue();
+      uint32_t from_dt = rc.total_ticks;
+      while (!s.isQueueEmpty()) {
+        rc.check_section(
+            &fas_queue[0].entry[fas_queue[0].read_idx & QUEUE_LEN_MASK]);
+        fas_queue[0]._testNextCommand();
+        fprintf(gp_file, "%.6f %.2f %d\n", rc.total_ticks / 16000000.0,
+                16000000.0 / rc.last_dt, rc.last_dt);
+      }
+      uint32_t to_dt = rc.total_ticks;
+      float planned_time = (to_dt - from_dt) * 1.0 / 16000000;
+      // This must be ensured, so that the stepper does not run out of
+      // commands
+      assert((i == 0) || (old_planned_time_in_buffer > 0.005));
+      old_planned_time_in_buffer = planned_time;
+    }
+    fprintf(gp_file, "EOF\n");
+    fprintf(gp_file, "plot $data using 1:2 with linespoints\n");
+    fprintf(gp_file, "pause -1\n");
+    fclose(gp_file);
+    test(!s.isRampGeneratorActive(), "too many commands created");
+    test(s.getCurrentPosition() == steps, "has not reached target position");
+    test(rc.min_dt == speed_us * 16, "max speed not reached");
+    test(seen_decel, "no deceleration reported");
+
+    // compare ramp times with the expected values v/a and v/d
+    float v = 1000000.0 / speed_us;
+    float t_acc = rc.accelerate_till / 16000000.0;
+    float t_dec = (rc.total_ticks - rc.coast_till) / 16000000.0;
+    float exp_acc = v / accel;
+    float exp_dec = v / (decel == 0 ? accel : decel);
+    printf("Total time %f, accelerate %f (expected %f), decelerate %f "
+           "(expected %f)\n",
+           rc.total_ticks / 16000000.0, t_acc, exp_acc, t_dec, exp_dec);
+    test(abs(t_acc - exp_acc) < 0.05 * exp_acc + 0.01,
+         "acceleration time out of range");
+    test(abs(t_dec - exp_dec) < 0.05 * exp_dec + 0.01,
+         "deceleration time out of range");
+    return rc.total_ticks / 16000000.0;
+  }
+
+  void stop_during_move() {
+    puts("Test stopMove() with deceleration");
+    init_queue();
+    FastAccelStepper s = FastAccelStepper();
+    s.init(NULL, 0, 0);
+    RampChecker rc = RampChecker();
+    s.setSpeedInUs(50);
+    s.setAcceleration(5000);
+    s.setDeceleration(50000);
+    s.move(1000000);
+    bool stopped = false;
+    int32_t stop_pos = 0;
+    for (int i = 0; i < 1000000; i++) {
+      if (!s.isRampGeneratorActive()) {
+        break;
+      }
+      if (!stopped && (s.getCurrentPosition() >= 20000)) {
+        stopped = true;
+        s.stopMove();
+        stop_pos = s.getCurrentPosition();
+      }
+      s.fill_queue();
+      while (!s.isQueueEmpty()) {
+        rc.check_section(
+            &fas_queue[0].entry[fas_queue[0].read_idx & QUEUE_LEN_MASK]);
+        fas_queue[0]._testNextCommand();
+      }
+    }
+    test(stopped, "stop not issued");
+    test(!s.isRampGeneratorActive(), "ramp not stopped");
+    // after 20000 steps with 5000 steps/s², the speed is ~14142 steps/s.
+    // So 2000 steps to stop with 50000 steps/s²
+    int32_t stop_steps = s.getCurrentPosition() - stop_pos;
+    printf("Stopped within %d steps\n", stop_steps);
+    test((stop_steps > 1800) && (stop_steps < 2300),
+         "stop distance does not match deceleration");
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  float t_sym = test.ramp("f1", 100000, 50, 10000, 0);
+  float t_fast_dec = test.ramp("f2", 100000, 50, 10000, 40000);
+  test(t_fast_dec < t_sym - 0.5, "higher deceleration does not save time");
+  test.ramp("f3", 100000, 50, 40000, 10000);
+  test.ramp("f4", 30000, 200, 1000, 100000);
+  test.ramp("f5", 30000, 200, 100000, 1000);
+  test.stop_during_move();
+  printf("TEST_13 PASSED\n");
+  return 0;
+}
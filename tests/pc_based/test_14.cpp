@@ -0,0 +1,191 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+#include "RampChecker.h"
+
+class FastAccelStepperTest {
+ public:
+  FastAccelStepper s;
+  RampChecker rc;
+  // step period at the junction position
+  uint32_t junction_dt;
+  int32_t junction_pos;
+  int32_t max_pos;
+
+  void init_queue() {
+    fas_queue[0].read_idx = 0;
+    fas_queue[1].read_idx = 0;
+    fas_queue[0].next_write_idx = 0;
+    fas_queue[1].next_write_idx = 0;
+  }
+  void init(const char *name) {
+    puts(name);
+    init_queue();
+    s = FastAccelStepper();
+    s.init(NULL, 0, 0);
+    rc = RampChecker();
+    junction_dt = 0;
+    junction_pos = 0x7fffffff;
+    max_pos = 0;
+    assert(0 == s.getCurrentPosition());
+  }
+
+  // run till ramp generator is idle and return time in s
+  float run(const char *name) {
+    char fname[100];
+    sprintf(fname, "test_14_%s.gnuplot", name);
+    FILE *gp_file = fopen(fname, "w");
+    fprintf(gp_file, "$data <<EOF\n");
+    float old_planned_time_in_buffer = 0;
+    for (int i = 0; i < 1000000; i++) {
+      if (!s.isRampGeneratorActive()) {
+        break;
+      }
+      s.fill_queue();
+      uint32_t from_dt = rc.total_ticks;
+      while (!s.isQueueEmpty()) {
+        struct queue_entry *e =
+            &fas_queue[0].entry[fas_queue[0].read_idx & QUEUE_LEN_MASK];
+        rc.check_section(e);
+        fas_queue[0]._testNextCommand();
+        int32_t pos = (int32_t)rc.pos;
+        if (pos > max_pos) {
+          max_pos = pos;
+        }
+        if ((junction_dt == 0) && (pos >= junction_pos) && (e->steps > 0)) {
+          junction_dt = rc.last_dt;
+        }
+        fprintf(gp_file, "%.6f %.2f %d\n", rc.total_ticks / 16000000.0,
+                16000000.0 / rc.last_dt, pos);
+      }
+      uint32_t to_dt = rc.total_ticks;
+      float planned_time = (to_dt - from_dt) * 1.0 / 16000000;
+      // This must be ensured, so that the stepper does not run out of
+      // commands
+      assert((i == 0) || (old_planned_time_in_buffer > 0.005));
+      old_planned_time_in_buffer = planned_time;
+    }
+    fprintf(gp_file, "EOF\n");
+    fprintf(gp_file, "plot $data using 1:2 with linespoints\n");
+    fprintf(gp_file, "pause -1\n");
+    fclose(gp_file);
+    test(!s.isRampGeneratorActive(), "ramp generator still active");
+    float t = rc.total_ticks / 16000000.0;
+    printf("Total time %f\n", t);
+    return t;
+  }
+
+  void blend_same_speed() {
+    init("Test single move");
+    s.setSpeedInUs(50);
+    s.setAcceleration(10000);
+    s.moveTo(30000);
+    float t_single = run("f1");
+    test(s.getCurrentPosition() == 30000, "target not reached");
+
+    init("Test three blended segments");
+    s.setSpeedInUs(50);
+    s.setAcceleration(10000);
+    test(s.queueMoveTo(10000) == MOVE_OK, "queueMoveTo failed");
+    test(s.queuedSegments() == 0, "first segment should start immediately");
+    test(s.queueMoveTo(20000) == MOVE_OK, "queueMoveTo failed");
+    test(s.queueMove(10000) == MOVE_OK, "queueMove failed");
+    test(s.queuedSegments() == 2, "two segments should be queued");
+    float t_blend = run("f2");
+    test(s.getCurrentPosition() == 30000, "target not reached");
+    test(s.queuedSegments() == 0, "segments not consumed");
+    test(t_blend < t_single * 1.01, "blended move too slow");
+  }
+
+  void blend_lower_speed() {
+    init("Test blending into slower segment");
+    s.setSpeedInUs(50);
+    s.setAcceleration(10000);
+    s.moveTo(30000);
+    s.setSpeedInUs(100);
+    s.queueMoveTo(50000);
+    junction_pos = 30000;
+    run("f3");
+    test(s.getCurrentPosition() == 50000, "target not reached");
+    printf("Step period at junction %d ticks\n", junction_dt);
+    // not below 100us, but no stop
+    test(junction_dt >= 1600 - 16, "too fast at junction");
+    test(junction_dt <= 1600 + 16, "too slow at junction");
+  }
+
+  void direction_change() {
+    init("Test segments with direction change");
+    s.setDirectionPin(0);
+    rc.reversing_allowed = true;
+    s.setSpeedInUs(50);
+    s.setAcceleration(10000);
+    s.moveTo(5000);
+    s.queueMoveTo(1000);
+    run("f4");
+    test(s.getCurrentPosition() == 1000, "target not reached");
+    test(max_pos <= 5000, "overshoot at direction change");
+  }
+
+  void queue_full() {
+    init("Test segment queue full");
+    s.setSpeedInUs(50);
+    s.setAcceleration(10000);
+    s.moveTo(1000);
+    for (int i = 0; i < RAMP_SEGMENT_QUEUE_LEN; i++) {
+      test(s.queueMove(1000) == MOVE_OK, "queue should accept segment");
+    }
+    test(s.queueMove(1000) == MOVE_ERR_SEGMENT_QUEUE_FULL,
+         "queue should be full");
+    s.moveTo(500);
+    test(s.queuedSegments() == 0, "moveTo should discard segments");
+    run("f5");
+    test(s.getCurrentPosition() == 500, "target not reached");
+  }
+
+  void acceleration_changed() {
+    init("Test acceleration change with queued segments");
+    s.setSpeedInUs(50);
+    s.setAcceleration(10000);
+    s.moveTo(1000);
+    s.setAcceleration(20000);
+    test(s.queueMove(1000) == MOVE_OK, "first queued segment sets accel");
+    s.setSpeedInUs(100);
+    test(s.queueMove(1000) == MOVE_OK, "speed may change per segment");
+    s.setAcceleration(10000);
+    test(s.queueMove(1000) == MOVE_ERR_SEGMENT_ACCELERATION_CHANGED,
+         "acceleration change should be rejected");
+    test(s.queuedSegments() == 2, "two segments should be queued");
+    run("f6");
+    test(s.getCurrentPosition() == 3000, "target not reached");
+    test(s.queueMove(1000) == MOVE_OK, "move after idle");
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  test.blend_same_speed();
+  test.blend_lower_speed();
+  test.direction_change();
+  test.queue_full();
+  test.acceleration_changed();
+  printf("TEST_14 PASSED\n");
+  return 0;
+}
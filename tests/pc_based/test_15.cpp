@@ -0,0 +1,248 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+#include "RampChecker.h"
+
+#define MAX_STEPS 40000
+
+// Records the step times of one queue
+struct axis_s {
+  uint64_t time;
+  uint32_t steps;
+  uint64_t step_time[MAX_STEPS];
+};
+struct axis_s axis[2];
+
+class FastAccelStepperTest {
+ public:
+  FastAccelStepper x;
+  FastAccelStepper y;
+
+  void init_queue() {
+    fas_queue[0].read_idx = 0;
+    fas_queue[1].read_idx = 0;
+    fas_queue[0].next_write_idx = 0;
+    fas_queue[1].next_write_idx = 0;
+  }
+  void init() {
+    init_queue();
+    x = FastAccelStepper();
+    y = FastAccelStepper();
+    x.init(NULL, 0, 0);
+    y.init(NULL, 1, 1);
+    for (uint8_t i = 0; i < 2; i++) {
+      axis[i].time = 0;
+      axis[i].steps = 0;
+    }
+  }
+
+  void drain(uint8_t q) {
+    struct axis_s *a = &axis[q];
+    while (!fas_queue[q].isQueueEmpty()) {
+      struct queue_entry *e =
+          &fas_queue[q].entry[fas_queue[q].read_idx & QUEUE_LEN_MASK];
+      if (e->steps == 0) {
+        a->time += e->ticks;
+      }
+      for (uint8_t i = 0; i < e->steps; i++) {
+        assert(a->steps < MAX_STEPS);
+        a->step_time[a->steps++] = a->time;
+        a->time += e->ticks;
+      }
+      fas_queue[q]._testNextCommand();
+    }
+  }
+
+  // maximum distance from the line in steps of axis q, evaluated after each
+  // step of any axis
+  float max_deviation(uint8_t q, uint32_t nq, uint32_t nother) {
+    uint8_t o = 1 - q;
+    uint32_t iq = 0;
+    uint32_t io = 0;
+    float max_dev = 0.0;
+    while ((iq < axis[q].steps) || (io < axis[o].steps)) {
+      uint64_t t;
+      if ((io < axis[o].steps) && ((iq == axis[q].steps) ||
+                                   (axis[o].step_time[io] <=
+                                    axis[q].step_time[iq]))) {
+        t = axis[o].step_time[io++];
+      } else {
+        t = axis[q].step_time[iq++];
+      }
+      // steps at the same time are evaluated together
+      if ((iq < axis[q].steps) && (axis[q].step_time[iq] == t)) {
+        continue;
+      }
+      if ((io < axis[o].steps) && (axis[o].step_time[io] == t)) {
+        continue;
+      }
+      float dev = fabs(iq - (float)io * nq / nother);
+      if (dev > max_dev) {
+        max_dev = dev;
+      }
+    }
+    return max_dev;
+  }
+
+  void coordinated(const char *name, int32_t nx, int32_t ny, uint32_t speed_x,
+                   uint32_t accel_x, uint32_t speed_y, uint32_t accel_y,
+                   float expected_time) {
+    printf("Test %s x=%d y=%d\n", name, nx, ny);
+    init();
+    x.setSpeedInUs(speed_x);
+    x.setAcceleration(accel_x);
+    y.setSpeedInUs(speed_y);
+    y.setAcceleration(accel_y);
+    if (ny < 0) {
+      y.setDirectionPin(0);
+    }
+    FastAccelStepperEngine engine;
+    FastAccelStepper *steppers[2] = {&x, &y};
+    int32_t positions[2] = {nx, ny};
+    test(engine.moveToCoordinated(steppers, positions, 2) == MOVE_OK,
+         "coordinated move rejected");
+    FastAccelStepper *master = (abs(nx) >= abs(ny)) ? &x : &y;
+#if (FAS_RAMP_TABLE == 1)
+    // the limits of the master are temporary and keep the ramp table
+    test(x._rg._table.isValidFor(x._rg._config.upm_sqrt_inv_accel),
+         "ramp table of x lost");
+    test(y._rg._table.isValidFor(y._rg._config.upm_sqrt_inv_accel),
+         "ramp table of y lost");
+#endif
+    test(master->isRampGeneratorActive(), "master ramp not started");
+    for (int i = 0; i < 1000000; i++) {
+      if (!master->isRampGeneratorActive() && (master->_coord_slaves == 0)) {
+        break;
+      }
+      master->fill_queue();
+      drain(0);
+      drain(1);
+      // the slave must not lag behind the master's queue
+      int64_t dt = (int64_t)axis[0].time - (int64_t)axis[1].time;
+      test(abs(dt) < TICKS_PER_S / 20, "queues out of sync");
+    }
+    test(master->_coord_slaves == 0, "coordination not finished");
+    test(x.getPositionAfterCommandsCompleted() == nx, "x not at target");
+    test(y.getPositionAfterCommandsCompleted() == ny, "y not at target");
+    test(axis[0].steps == (uint32_t)abs(nx), "wrong number of x steps");
+    test(axis[1].steps == (uint32_t)abs(ny), "wrong number of y steps");
+
+    float tx = axis[0].step_time[axis[0].steps - 1] / 16000000.0;
+    float ty = axis[1].step_time[axis[1].steps - 1] / 16000000.0;
+    // deviation is measured in steps of the slave, which has less steps
+    float dev = (abs(nx) >= abs(ny)) ? max_deviation(1, abs(ny), abs(nx))
+                                     : max_deviation(0, abs(nx), abs(ny));
+    printf("  last step x=%.4fs y=%.4fs deviation=%.2f steps\n", tx, ty,
+           dev);
+    test(fabs(tx - ty) < 0.001, "axes do not finish together");
+    test(fabs(tx - expected_time) < 0.02 * expected_time, "unexpected time");
+    test(dev <= 1.25, "slave deviates from the line");
+
+    // the speed and acceleration settings for single moves are unchanged
+    test(x.getSpeedInUs() == speed_x, "speed of x modified");
+    test(x.getAcceleration() == accel_x, "acceleration of x modified");
+    test(y.getSpeedInUs() == speed_y, "speed of y modified");
+    test(y.getAcceleration() == accel_y, "acceleration of y modified");
+  }
+
+  void force_stop() {
+    puts("Test force stop of master");
+    init();
+    x.setSpeedInUs(50);
+    x.setAcceleration(10000);
+    y.setSpeedInUs(50);
+    y.setAcceleration(10000);
+    FastAccelStepperEngine engine;
+    FastAccelStepper *steppers[2] = {&x, &y};
+    int32_t positions[2] = {10000, 4000};
+    test(engine.moveToCoordinated(steppers, positions, 2) == MOVE_OK,
+         "coordinated move rejected");
+    for (int i = 0; i < 20; i++) {
+      x.fill_queue();
+      drain(0);
+      drain(1);
+    }
+    x.fill_queue();
+    test(!y.isQueueEmpty(), "slave has no commands");
+    int32_t y_pos = y.getCurrentPosition();
+    test(y_pos > 0, "slave not moved");
+    x.forceStopAndNewPosition(0);
+    test(x._coord_slaves == 0, "coordination not finished");
+    test(x.isQueueEmpty() && !x.isRunning(), "master not stopped");
+    test(y.isQueueEmpty() && !y.isRunning(), "slave not stopped");
+    test(y.getCurrentPosition() == y_pos, "slave position changed");
+    test(y.getPositionAfterCommandsCompleted() == y_pos,
+         "slave queue end not at current position");
+    x.fill_queue();
+    test(y.isQueueEmpty(), "slave still commanded");
+  }
+
+  void invalid() {
+    puts("Test invalid");
+    init();
+    x.setSpeedInUs(100);
+    x.setAcceleration(1000);
+    FastAccelStepperEngine engine;
+    FastAccelStepper *steppers[2] = {&x, &y};
+    int32_t positions[2] = {1000, 1000};
+    test(engine.moveToCoordinated(steppers, positions, 2) ==
+             MOVE_ERR_SPEED_IS_UNDEFINED,
+         "missing speed not detected");
+    y.setSpeedInUs(100);
+    test(engine.moveToCoordinated(steppers, positions, 2) ==
+             MOVE_ERR_ACCELERATION_IS_UNDEFINED,
+         "missing acceleration not detected");
+    y.setAcceleration(1000);
+    y.setDirectionPin(PIN_UNDEFINED);
+    positions[1] = -1000;
+    test(engine.moveToCoordinated(steppers, positions, 2) ==
+             MOVE_ERR_NO_DIRECTION_PIN,
+         "missing direction pin not detected");
+    positions[1] = 1000;
+    steppers[1] = &x;
+    test(engine.moveToCoordinated(steppers, positions, 2) ==
+             MOVE_ERR_COORDINATED_INVALID,
+         "duplicate stepper not detected");
+    test(engine.moveToCoordinated(steppers, positions, 0) ==
+             MOVE_ERR_COORDINATED_INVALID,
+         "empty list not detected");
+    test(!x.isRampGeneratorActive(), "ramp started on error");
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  test.invalid();
+  test.force_stop();
+  // same limits: x is limiting. 10000 steps at 20kHz and 10000 steps/s²
+  // => 2s ramp up/down, 0 coasting => 2s
+  test.coordinated("f1", 10000, 4000, 50, 10000, 50, 10000, 2.0);
+  // y is limiting with speed 5kHz for 6000 steps
+  // => x runs max 8.33kHz, acc/dec time 2*0.833s, 10000 steps need 2.033s
+  test.coordinated("f2", 10000, 6000, 50, 10000, 200, 10000, 2.033);
+  // y is limiting with acceleration 2000 for 5000 steps => x 4000 steps/s²
+  // x speed 10kHz (2.5s) is not reached: time = 2*sqrt(10000/4000) = 3.16s
+  test.coordinated("f3", 10000, 5000, 100, 10000, 100, 2000, 3.162);
+  // y is master and moves backward
+  test.coordinated("f4", 3000, -7000, 200, 5000, 100, 5000, 2.367);
+  printf("TEST_15 PASSED\n");
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+#include "RampChecker.h"
+
+class FastAccelStepperTest {
+ public:
+  void init_queue() {
+    fas_queue[0].read_idx = 0;
+    fas_queue[1].read_idx = 0;
+    fas_queue[0].next_write_idx = 0;
+    fas_queue[1].next_write_idx = 0;
+  }
+
+  // returns time of the move in s
+  float move_in_time(int32_t steps, uint32_t duration_ms, uint32_t speed_us,
+                     uint32_t accel, uint32_t decel) {
+    printf("Test steps=%d in %dms speed=%dus accel=%d decel=%d\n", steps,
+           duration_ms, speed_us, accel, decel);
+    init_queue();
+    FastAccelStepper s = FastAccelStepper();
+    s.init(NULL, 0, 0);
+    RampChecker rc = RampChecker();
+    s.setSpeedInUs(speed_us);
+    s.setAcceleration(accel);
+    s.setDeceleration(decel);
+    test(s.moveInTime(steps, duration_ms) == MOVE_OK, "move rejected");
+    for (int i = 0; i < 1000000; i++) {
+      if (!s.isRampGeneratorActive()) {
+        break;
+      }
+      s.fill_queue();
+      while (!s.isQueueEmpty()) {
+        rc.check_section(
+            &fas_queue[0].entry[fas_queue[0].read_idx & QUEUE_LEN_MASK]);
+        fas_queue[0]._testNextCommand();
+      }
+    }
+    test(s.getCurrentPosition() == steps, "has not reached target position");
+    // the move ends with the last step, so the last period does not count
+    float t = (rc.total_ticks - rc.last_dt) / 16000000.0;
+    printf("  time %.4fs max speed %dus\n", t, rc.min_dt / 16);
+    test(rc.min_dt >= speed_us * 16, "max speed exceeded");
+    test(fabs(t * 1000.0 - duration_ms) < 0.02 * duration_ms,
+         "duration not met");
+    test(s.getSpeedInUs() == speed_us, "speed setting modified");
+    test(s.getAcceleration() == accel, "acceleration setting modified");
+    return t;
+  }
+
+  void errors() {
+    puts("Test errors");
+    init_queue();
+    FastAccelStepper s = FastAccelStepper();
+    s.init(NULL, 0, 0);
+    test(s.moveInTime(1000, 1000) == MOVE_ERR_SPEED_IS_UNDEFINED,
+         "missing speed not detected");
+    s.setSpeedInUs(100);
+    test(s.moveInTime(1000, 1000) == MOVE_ERR_ACCELERATION_IS_UNDEFINED,
+         "missing acceleration not detected");
+    s.setAcceleration(10000);
+    // 10000 steps with 10000 steps/s² need at least 2s
+    test(s.moveToInTime(10000, 1900) == MOVE_ERR_DURATION_TOO_SHORT,
+         "too short duration for acceleration not detected");
+    // 10000 steps with max 10000 steps/s need more than 1s
+    test(s.moveToInTime(10000, 1000) == MOVE_ERR_DURATION_TOO_SHORT,
+         "too short duration for speed not detected");
+    test(!s.isRampGeneratorActive(), "ramp started on error");
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  test.errors();
+  // examples from doc/ramp.md: 32000 steps in 10s
+  test.move_in_time(32000, 10000, 100, 3556, 0);
+  test.move_in_time(32000, 10000, 100, 1333, 0);
+  // triangle ramp 10000 steps/s² for 10000 steps is 2s
+  test.move_in_time(10000, 2050, 50, 10000, 0);
+  test.move_in_time(1000, 10000, 50, 10000, 0);
+  test.move_in_time(100000, 90000, 20, 1000, 0);
+  // different deceleration
+  test.move_in_time(32000, 10000, 100, 1000, 4000);
+  test.move_in_time(32000, 10000, 100, 5000, 1000);
+  printf("TEST_16 PASSED\n");
+  return 0;
+}
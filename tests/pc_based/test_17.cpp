@@ -0,0 +1,100 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "RampCalculator.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+// Compare upm_float and fixed point ramp math against double precision:
+//	ticks = TICKS_PER_S / sqrt(2 * accel * steps)
+//	steps = TICKS_PER_S² / (2 * accel * ticks²)
+static void check_backends(uint32_t accel) {
+  printf("Check ramp math for acceleration=%u\n", accel);
+  upm_float upm_sqrt_inv_accel = upm_multiply(upm_rsqrt(upm_from(accel)),
+                                              UPM_TICKS_PER_S_DIV_SQRT_OF_2);
+  upm_float upm_inv_accel2 = upm_multiply(
+      UPM_TICKS_PER_S,
+      upm_divide(upm_shr(UPM_TICKS_PER_S, 1), upm_from(accel)));
+  uint32_t sqrt_inv_accel = calculate_sqrt_inv_accel_fixed(TICKS_PER_S, accel);
+  double exact_sqrt_inv_accel = TICKS_PER_S / sqrt(2.0 * accel);
+  test(fabs(sqrt_inv_accel / 256.0 - exact_sqrt_inv_accel) <
+           1e-4 * exact_sqrt_inv_accel + 1.0 / 256,
+       "sqrt_inv_accel deviates");
+
+  double max_err_upm = 0.0;
+  double max_err_fixed = 0.0;
+  uint32_t last_ticks = 0xffffffff;
+  for (uint32_t steps = 1; steps < 0x40000000; steps += 1 + steps / 128) {
+    double exact = exact_sqrt_inv_accel / sqrt((double)steps);
+    if ((exact < MIN_DELTA_TICKS) || (exact > 0xffffffff)) {
+      continue;
+    }
+    uint32_t ticks_upm = calculate_ticks_v8(steps, upm_sqrt_inv_accel);
+    uint32_t ticks_fixed = calculate_ticks_fixed(steps, sqrt_inv_accel);
+    // the tick sequence must not increase with increasing ramp steps
+    test(ticks_fixed <= last_ticks, "fixed point ticks not monotonic");
+    last_ticks = ticks_fixed;
+    // error without the rounding to integer
+    double err_upm = max(fabs(ticks_upm - exact) - 0.5, 0.0) / exact;
+    double err_fixed = max(fabs(ticks_fixed - exact) - 0.5, 0.0) / exact;
+    max_err_upm = max(max_err_upm, err_upm);
+    max_err_fixed = max(max_err_fixed, err_fixed);
+    test(err_fixed < 1e-4, "fixed point ticks deviate");
+  }
+  printf("  ticks: max error upm=%.6f fixed=%.6f\n", max_err_upm,
+         max_err_fixed);
+  test(max_err_fixed < max_err_upm, "fixed point is not more precise");
+
+  max_err_upm = 0.0;
+  max_err_fixed = 0.0;
+  for (uint32_t ticks = MIN_DELTA_TICKS; ticks < 0x1000000;
+       ticks += 1 + ticks / 128) {
+    double exact = exact_sqrt_inv_accel / ticks;
+    exact *= exact;
+    if ((exact < 100.0) || (exact > 0xffffffff)) {
+      continue;
+    }
+    uint32_t steps_upm =
+        upm_to_u32(upm_multiply(upm_inv_accel2, upm_rsquare(upm_from(ticks))));
+    uint32_t steps_fixed = calculate_ramp_steps_fixed(ticks, sqrt_inv_accel);
+    // error without the truncation to integer
+    double err_upm = max(fabs(steps_upm - exact) - 1.0, 0.0) / exact;
+    double err_fixed = max(fabs(steps_fixed - exact) - 1.0, 0.0) / exact;
+    max_err_upm = max(max_err_upm, err_upm);
+    max_err_fixed = max(max_err_fixed, err_fixed);
+    test(err_fixed < 1e-4, "fixed point ramp steps deviate");
+  }
+  printf("  ramp steps: max error upm=%.6f fixed=%.6f\n", max_err_upm,
+         max_err_fixed);
+}
+
+int main() {
+  test(fixed_isqrt(0) == 0, "isqrt(0)");
+  test(fixed_isqrt(1) == 1, "isqrt(1)");
+  test(fixed_isqrt(99) == 9, "isqrt(99)");
+  test(fixed_isqrt(100) == 10, "isqrt(100)");
+  test(fixed_isqrt(0xffffffff) == 0xffff, "isqrt(max)");
+  check_backends(1);
+  check_backends(100);
+  check_backends(10000);
+  check_backends(1000000);
+  check_backends(100000000);
+  printf("TEST_17 PASSED\n");
+  return 0;
+}
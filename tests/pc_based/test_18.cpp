@@ -0,0 +1,192 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+#define MAX_SAMPLES 100000
+
+class FastAccelStepperTest {
+ public:
+  FastAccelStepper s;
+  uint64_t time;
+  // estimated completion time after each fill_queue()
+  uint32_t samples;
+  uint64_t sample_time[MAX_SAMPLES];
+  uint64_t estimate[MAX_SAMPLES];
+
+  void init() {
+    fas_queue[0].read_idx = 0;
+    fas_queue[0].next_write_idx = 0;
+    s = FastAccelStepper();
+    s.init(NULL, 0, 0);
+    time = 0;
+    samples = 0;
+  }
+
+  void drain() {
+    while (!s.isQueueEmpty()) {
+      struct queue_entry *e =
+          &fas_queue[0].entry[fas_queue[0].read_idx & QUEUE_LEN_MASK];
+      if (e->steps == 0) {
+        time += e->ticks;
+      }
+      time += (uint64_t)e->ticks * e->steps;
+      fas_queue[0]._testNextCommand();
+    }
+  }
+
+  void sample() {
+    uint32_t us = s.getRemainingTimeInUs();
+    test(us != 0xffffffff, "unexpected unlimited time");
+    assert(samples < MAX_SAMPLES);
+    sample_time[samples] = time;
+    estimate[samples] = time + (uint64_t)us * 16;
+    samples++;
+  }
+
+  // run until position is reached, calling action() once at given position
+  void run(int32_t action_pos, void (*action)(FastAccelStepper *)) {
+    bool done = (action == NULL);
+    for (int i = 0; i < 1000000; i++) {
+      if (!s.isRampGeneratorActive()) {
+        break;
+      }
+      if (!done && (s.getPositionAfterCommandsCompleted() >= action_pos)) {
+        action(&s);
+        done = true;
+        // estimates before the action are not valid
+        samples = 0;
+      }
+      s.fill_queue();
+      sample();
+      drain();
+    }
+    test(!s.isRampGeneratorActive(), "ramp not finished");
+    test(s.getRemainingTimeInUs() == 0, "remaining time for stopped motor");
+  }
+
+  // Compare the estimated completion time with the real one, which is the end
+  // of the last queue entry. The entry in execution is not part of the
+  // estimate.
+  void check(const char *name, float max_err, uint32_t decel) {
+    float end = time / 16000000.0;
+    // The absolute tolerance covers the entry in execution and the
+    // quantization of the slow steps at ramp end: 2x the last step period
+    float abs_err = 2.0 / sqrt(2.0 * decel);
+    float worst = 0.0;
+    bool ok = true;
+    for (uint32_t i = 0; i < samples; i++) {
+      float remaining = (time - sample_time[i]) / 16000000.0;
+      float err = fabs(((float)estimate[i] - time) / 16000000.0);
+      if (err > max_err * remaining + abs_err) {
+        printf("  estimate at %.4fs off by %.4fs\n",
+               sample_time[i] / 16000000.0, err);
+        ok = false;
+      }
+      if ((remaining > 0.5) && (err / remaining > worst)) {
+        worst = err / remaining;
+      }
+    }
+    printf("%s: end=%.4fs %u estimates, max relative error=%.4f\n", name, end,
+           samples, worst);
+    test(samples > 0, "no estimates");
+    test(ok, "estimate too far off");
+  }
+
+  void move(const char *name, int32_t steps, uint32_t speed_us, uint32_t accel,
+            uint32_t decel, float expected_s) {
+    init();
+    s.setSpeedInUs(speed_us);
+    s.setAcceleration(accel);
+    s.setDeceleration(decel);
+    test(s.getRemainingTimeInUs() == 0, "remaining time before move");
+    s.moveTo(steps);
+    float est = s.getRemainingTimeInUs() / 1000000.0;
+    run(0, NULL);
+    check(name, 0.02, decel ? decel : accel);
+    test(fabs(est - expected_s) < 0.02 * expected_s,
+         "unexpected estimate at start");
+  }
+
+  static void extend(FastAccelStepper *s) { s->moveTo(30000); }
+  static void reverse(FastAccelStepper *s) { s->moveTo(-2000); }
+
+  void modified_move(const char *name, void (*action)(FastAccelStepper *)) {
+    init();
+    s.setDirectionPin(0);
+    s.setSpeedInUs(50);
+    s.setAcceleration(10000);
+    s.moveTo(20000);
+    run(5000, action);
+    check(name, 0.02, 10000);
+  }
+
+  void segments() {
+    init();
+    s.setSpeedInUs(50);
+    s.setAcceleration(10000);
+    s.moveTo(5000);
+    test(s.queueMoveTo(10000) == MOVE_OK, "segment rejected");
+    s.setSpeedInUs(100);
+    test(s.queueMoveTo(20000) == MOVE_OK, "segment rejected");
+    run(0, NULL);
+    check("segments", 0.02, 10000);
+  }
+
+  void running() {
+    init();
+    s.setSpeedInUs(100);
+    s.setAcceleration(10000);
+    s.runForward();
+    s.fill_queue();
+    test(s.getRemainingTimeInUs() == 0xffffffff,
+         "keep running must be unlimited");
+    for (int i = 0; i < 200; i++) {
+      s.fill_queue();
+      drain();
+    }
+    // 10kHz with 10000 steps/s² need 1s to stop
+    s.stopMove();
+    float est = s.getRemainingTimeInUs() / 1000000.0;
+    printf("stop: estimate=%.4fs\n", est);
+    test(fabs(est - 1.0) < 0.02, "unexpected stop time");
+    samples = 0;
+    run(0, NULL);
+    check("stop", 0.02, 10000);
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  // triangle: 10000 steps with 10000 steps/s² => 2s
+  test.move("triangle", 10000, 50, 10000, 0, 2.0);
+  // 1s ramp up/down with 5000 steps each and 22000 steps coasting => 4.2s
+  test.move("trapezoid", 32000, 100, 10000, 0, 4.2);
+  // 5kHz: ramp up 5s/12500 steps, ramp down 2.5s/6250 steps and 81250 steps
+  // coasting => 23.75s
+  test.move("accel<decel", 100000, 200, 1000, 2000, 23.75);
+  test.move("accel>decel", 100000, 200, 2000, 1000, 23.75);
+  // running move to 20000 is extended to 30000
+  test.modified_move("extend", FastAccelStepperTest::extend);
+  test.modified_move("reverse", FastAccelStepperTest::reverse);
+  test.segments();
+  test.running();
+  printf("TEST_18 PASSED\n");
+  return 0;
+}
@@ -0,0 +1,173 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+#define TICKS_PER_MS 16000
+
+// Target speed profile in Hz, which is streamed with 1kHz
+struct profile_s {
+  uint32_t till_ms;
+  int32_t speed_hz;
+};
+
+class FastAccelStepperTest {
+ public:
+  FastAccelStepper s;
+  uint64_t time;
+  uint64_t last_step_time;
+  // signed speed derived from the last two steps
+  float speed;
+  int32_t pos;
+
+  void init() {
+    fas_queue[0].read_idx = 0;
+    fas_queue[0].next_write_idx = 0;
+    s = FastAccelStepper();
+    s.init(NULL, 0, 0);
+    s.setDirectionPin(0);
+    time = 0;
+    last_step_time = 0;
+    speed = 0.0;
+    pos = 0;
+  }
+
+  void process_entry() {
+    struct queue_entry *e =
+        &fas_queue[0].entry[fas_queue[0].read_idx & QUEUE_LEN_MASK];
+    for (uint8_t i = 0; i < e->steps; i++) {
+      float v = 16000000.0 / (time - last_step_time);
+      speed = e->countUp ? v : -v;
+      pos += e->countUp ? 1 : -1;
+      last_step_time = time;
+      time += e->ticks;
+    }
+    if (e->steps == 0) {
+      time += e->ticks;
+    }
+    fas_queue[0]._testNextCommand();
+  }
+
+  // Runs the profile and checks at the end of each section, that the target
+  // speed is reached. The time to reach the speed must match the
+  // acceleration.
+  void run(const struct profile_s *profile, uint8_t n, uint32_t max_hz,
+           uint32_t accel) {
+    init();
+    s.setSpeedInHz(max_hz);
+    s.setAcceleration(accel);
+    uint32_t max_ticks = s.getSpeedInTicks();
+    uint64_t next_update = 0;
+    float prev_target = 0.0;
+    for (uint8_t i = 0; i < n; i++) {
+      int32_t target_hz = profile[i].speed_hz;
+      float target = target_hz;
+      if (target > max_hz) {
+        target = max_hz;
+      } else if (target < -(float)max_hz) {
+        target = -(float)max_hz;
+      }
+      printf("Section %d: target %d Hz till %d ms\n", i, target_hz,
+             profile[i].till_ms);
+      uint64_t start = time;
+      uint64_t reached = 0;
+      uint64_t end = (uint64_t)profile[i].till_ms * TICKS_PER_MS;
+      while (time < end) {
+        if (time >= next_update) {
+          test(s.setTargetSpeed(target_hz * 1000) == MOVE_OK,
+               "target speed rejected");
+          next_update += TICKS_PER_MS;
+        }
+        s.fill_queue();
+        if (s.isQueueEmpty()) {
+          // idle
+          time = next_update;
+          continue;
+        }
+        process_entry();
+        if ((reached == 0) && (fabs(speed - target) <= 0.01 * fabs(target))) {
+          reached = time;
+        }
+      }
+      if (target == 0.0) {
+        test(!s.isRampGeneratorActive(), "not stopped");
+        test(!s.isRunning(), "still running");
+        prev_target = 0.0;
+        continue;
+      }
+      float expected = fabs(target - prev_target) / accel;
+      float needed = (reached - start) / 16000000.0;
+      printf("  speed %.1f Hz reached after %.4fs (expected %.4fs) pos=%d\n",
+             speed, needed, expected, pos);
+      test(reached != 0, "target speed not reached");
+      test(fabs(speed - target) <= 0.01 * fabs(target), "speed not kept");
+      // the queue adds latency to the reaction on the new target
+      test(needed >= 0.95 * expected, "acceleration too high");
+      test(needed <= 1.05 * expected + 0.03, "acceleration too low");
+      prev_target = target;
+    }
+    test(s.getSpeedInTicks() == max_ticks, "max speed modified");
+    test(s.getAcceleration() == accel, "acceleration modified");
+  }
+
+  void errors() {
+    puts("Test errors");
+    init();
+    test(s.setTargetSpeed(1000000) == MOVE_ERR_SPEED_IS_UNDEFINED,
+         "missing speed not detected");
+    s.setSpeedInHz(10000);
+    test(s.setTargetSpeed(1000000) == MOVE_ERR_ACCELERATION_IS_UNDEFINED,
+         "missing acceleration not detected");
+    s.setAcceleration(10000);
+    s.setDirectionPin(PIN_UNDEFINED);
+    test(s.setTargetSpeed(-1000000) == MOVE_ERR_NO_DIRECTION_PIN,
+         "missing direction pin not detected");
+    test(!s.isRampGeneratorActive(), "ramp started on error");
+    test(s.setTargetSpeed(0) == MOVE_OK, "stop rejected");
+    test(!s.isRampGeneratorActive(), "ramp started on zero speed");
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  test.errors();
+  const struct profile_s profile[] = {
+      // 0.5s to 5kHz, 0.5s to 10kHz
+      {1000, 5000},
+      {2000, 10000},
+      // 1.5s reversal to -5kHz
+      {3700, -5000},
+      // limited to 15kHz => 2s
+      {6500, 20000},
+      // 1.5s to standstill
+      {8500, 0},
+      // restart from standstill in 0.3s
+      {9500, 3000},
+      {10000, 0},
+  };
+  test.run(profile, sizeof(profile) / sizeof(profile[0]), 15000, 10000);
+  // streaming the same target does not disturb a slow ramp: 4s ramps
+  const struct profile_s slow[] = {
+      {5000, -400},
+      {9500, 0},
+  };
+  test.run(slow, sizeof(slow) / sizeof(slow[0]), 1000, 100);
+  printf("TEST_19 PASSED\n");
+  return 0;
+}
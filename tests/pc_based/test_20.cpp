@@ -0,0 +1,171 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+#define TICKS_PER_MS 16000
+
+class FastAccelStepperTest {
+ public:
+  FastAccelStepper s;
+  uint64_t time;
+  uint32_t commands;
+  // queue ran empty while the ramp generator has been active
+  uint32_t underruns;
+
+  void init() {
+    fas_queue[0].read_idx = 0;
+    fas_queue[0].next_write_idx = 0;
+    fas_queue[0]._isRunning = false;
+    s = FastAccelStepper();
+    s.init(NULL, 0, 0);
+    time = 0;
+    commands = 0;
+    underruns = 0;
+  }
+
+  void process_entry() {
+    struct queue_entry *e =
+        &fas_queue[0].entry[fas_queue[0].read_idx & QUEUE_LEN_MASK];
+    if (e->steps == 0) {
+      time += e->ticks;
+    }
+    time += (uint64_t)e->ticks * e->steps;
+    fas_queue[0]._testNextCommand();
+    commands++;
+    if (s.isQueueEmpty()) {
+      fas_queue[0]._isRunning = false;
+      if (s.isRampGeneratorActive()) {
+        underruns++;
+      }
+    }
+  }
+
+  // Execute the queue in real time, while fill_queue() is called every
+  // period_ms till end_ms
+  void run(uint32_t period_ms, uint32_t end_ms) {
+    uint64_t next_fill = time;
+    uint64_t end = (uint64_t)end_ms * TICKS_PER_MS;
+    while (time < end) {
+      while (!s.isQueueEmpty() && (time < next_fill)) {
+        process_entry();
+      }
+      if (time < next_fill) {
+        // idle
+        time = next_fill;
+      }
+      s.fill_queue();
+      if (!s.isQueueEmpty()) {
+        fas_queue[0]._isRunning = true;
+      }
+      next_fill += (uint64_t)period_ms * TICKS_PER_MS;
+    }
+  }
+
+  uint32_t move_commands(uint32_t duration_us) {
+    init();
+    if (duration_us != 0) {
+      test(s.setCommandDurationInUs(duration_us) == 0, "duration rejected");
+    }
+    s.setSpeedInUs(50);
+    s.setAcceleration(100000);
+    s.moveTo(20000);
+    run(1, 2000);
+    test(!s.isRampGeneratorActive(), "move not finished");
+    test(s.getCurrentPosition() == 20000, "target not reached");
+    printf("command duration %uus: %u commands, %u underruns\n",
+           s.getCommandDurationInUs(), commands, underruns);
+    test(underruns == 0, "queue underrun");
+    return commands;
+  }
+
+  void command_duration() {
+    uint32_t default_cmds = move_commands(0);
+    uint32_t long_cmds = move_commands(4000);
+    test(long_cmds < default_cmds * 6 / 10, "too many commands");
+  }
+
+  void adaptive_lookahead() {
+    init();
+    test(s.getLookAheadInUs() == 20000, "default lookahead");
+    test(s.setLookAheadInMs(5, 60) == 0, "lookahead rejected");
+    test(s.getLookAheadInUs() == 20000, "lookahead not kept");
+    s.setCommandDurationInUs(4000);
+    s.setSpeedInUs(50);
+    s.setAcceleration(100000);
+    s.runForward();
+
+    // late fill calls: the lookahead must grow and the underruns stop
+    run(30, 1000);
+    printf("fill every 30ms: lookahead %uus, %u underruns\n",
+           s.getLookAheadInUs(), underruns);
+    test(underruns > 0, "expected initial underruns");
+    test(s.getLookAheadInUs() > 30000, "lookahead not increased");
+    underruns = 0;
+    run(30, 2000);
+    test(underruns == 0, "underruns after adaptation");
+
+    // frequent fill calls: the lookahead shrinks to the minimum
+    run(1, 3000);
+    printf("fill every 1ms: lookahead %uus, %u underruns\n",
+           s.getLookAheadInUs(), underruns);
+    test(s.getLookAheadInUs() == 5000, "lookahead not reduced");
+    test(underruns == 0, "underruns with short lookahead");
+
+    // fixed lookahead is not adapted
+    test(s.setLookAheadInMs(10, 10) == 0, "lookahead rejected");
+    test(s.getLookAheadInUs() == 10000, "lookahead not clamped");
+    run(30, 4000);
+    test(s.getLookAheadInUs() == 10000, "fixed lookahead modified");
+  }
+
+  void errors() {
+    init();
+    test(s.setLookAheadInMs(0, 10) == -1, "min 0 accepted");
+    test(s.setLookAheadInMs(20, 10) == -1, "min > max accepted");
+    test(s.getLookAheadInUs() == 20000, "lookahead modified");
+    test(s.getCommandDurationInUs() == 2000, "default command duration");
+    test(s.setCommandDurationInUs(100) == -1, "too short duration accepted");
+    test(s.setCommandDurationInUs(30000) == -1, "too long duration accepted");
+    test(s.setCommandDurationInUs(0xffffffff) == -1, "overflow accepted");
+    test(s.getCommandDurationInUs() == 2000, "command duration modified");
+    // documented range
+    test(s.setCommandDurationInUs(MIN_CMD_DURATION_US - 1) == -1,
+         "duration below range accepted");
+    test(s.setCommandDurationInUs(MAX_CMD_DURATION_US + 1) == -1,
+         "duration above range accepted");
+    test(s.setCommandDurationInUs(MIN_CMD_DURATION_US) == 0,
+         "minimum duration rejected");
+    test(s.getCommandDurationInUs() == MIN_CMD_DURATION_US,
+         "minimum duration");
+    test(s.setCommandDurationInUs(MAX_CMD_DURATION_US) == 0,
+         "maximum duration rejected");
+    test(s.getCommandDurationInUs() == MAX_CMD_DURATION_US,
+         "maximum duration");
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  test.errors();
+  test.command_duration();
+  test.adaptive_lookahead();
+  printf("TEST_20 PASSED\n");
+  return 0;
+}
@@ -0,0 +1,110 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+// The queue must work for any QUEUE_LEN selected by FAS_QUEUE_LEN, so the
+// test makes no assumption about the length. Run e.g. with:
+//	make test CXXFLAGS="-DTEST -Werror -g -DF_CPU=16000000 -I../../src
+//	                    -DFAS_QUEUE_LEN=256"
+class FastAccelStepperTest {
+ public:
+  FastAccelStepper s;
+
+  void init() {
+    fas_queue[0].read_idx = 0;
+    fas_queue[0].next_write_idx = 0;
+    s = FastAccelStepper();
+    s.init(NULL, 0, 0);
+    s.setDirectionPin(0);
+    // ticks sums wrap around during the test
+    fas_queue[0]._ticks_written = 0xfff00000;
+    fas_queue[0]._ticks_started = 0xfff00000;
+  }
+
+  void check_layout() {
+    printf("QUEUE_LEN=%d index size=%d byte\n", QUEUE_LEN,
+           (int)sizeof(queue_idx_t));
+    test((QUEUE_LEN & QUEUE_LEN_MASK) == 0, "QUEUE_LEN not power of two");
+    // The free running indices must be able to represent a full queue
+    queue_idx_t full = QUEUE_LEN;
+    test(full != 0, "index too small for queue length");
+    test(sizeof(fas_queue[0].entry) / sizeof(fas_queue[0].entry[0]) ==
+             QUEUE_LEN,
+         "entry array size");
+  }
+
+  void add(uint8_t steps, uint16_t ticks) {
+    struct stepper_command_s cmd = {
+        .ticks = ticks, .steps = steps, .count_up = true};
+    test(s.addQueueEntry(&cmd) == AQE_OK, "entry rejected");
+  }
+
+  // Fill and drain the queue several times, so that the free running indices
+  // wrap around. Entries, ticks and position must be consistent.
+  void wrap_around() {
+    init();
+    int32_t pos = 0;
+    uint32_t added = 0;
+    // As one entry is left in the queue, the fill level wanders through all
+    // index combinations during three wrap arounds.
+    uint32_t index_range = 1UL << (8 * sizeof(queue_idx_t));
+    while (added < 3 * index_range) {
+      uint32_t ticks = 0;
+      while (!s.isQueueFull()) {
+        uint8_t steps = 1 + (added % 5);
+        add(steps, 4000);
+        if (fas_queue[0].queueEntries() > 1) {
+          ticks += steps * 4000;
+        }
+        added++;
+      }
+      test(fas_queue[0].queueEntries() == QUEUE_LEN, "full queue entries");
+      test(fas_queue[0].ticksInQueue() == ticks, "ticks in full queue");
+      test(fas_queue[0].hasTicksInQueue(ticks), "has ticks in full queue");
+      test(!fas_queue[0].hasTicksInQueue(ticks + 1), "has too many ticks");
+      struct stepper_command_s cmd = {.ticks = 4000, .steps = 1,
+                                      .count_up = true};
+      test(s.addQueueEntry(&cmd) == AQE_QUEUE_FULL, "full queue accepts");
+      // leave one entry in the queue
+      while (fas_queue[0].queueEntries() > 1) {
+        struct queue_entry *e =
+            &fas_queue[0].entry[fas_queue[0].read_idx & QUEUE_LEN_MASK];
+        pos += e->steps;
+        fas_queue[0]._testNextCommand();
+        test(s.getCurrentPosition() == pos, "position");
+      }
+      test(fas_queue[0].ticksInQueue() == 0, "ticks of single entry");
+    }
+    test(s.getPositionAfterCommandsCompleted() ==
+             pos + fas_queue[0]
+                       .entry[fas_queue[0].read_idx & QUEUE_LEN_MASK]
+                       .steps,
+         "position after commands completed");
+    printf("%u entries added\n", added);
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  test.check_layout();
+  test.wrap_around();
+  printf("TEST_21 PASSED\n");
+  return 0;
+}
@@ -0,0 +1,137 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+// getCurrentPosition() is checked after every step against the position
+// counted here. The queue is processed like the avr ISR does: steps are
+// decremented within the entry and the position counter is advanced on start
+// of the next command.
+//
+// Passes with FAS_POSITION_COUNTER=0 and 1
+class FastAccelStepperTest {
+ public:
+  FastAccelStepper s;
+  int32_t pos;
+  uint32_t checks;
+
+  FastAccelStepperTest() : checks(0) {}
+
+  void init() {
+    fas_queue[0].read_idx = 0;
+    fas_queue[0].next_write_idx = 0;
+    s = FastAccelStepper();
+    s.init(NULL, 0, 0);
+    s.setDirectionPin(0);
+    pos = 0;
+  }
+
+  void check() {
+    test(s.getCurrentPosition() == pos, "position mismatch");
+    checks++;
+  }
+
+  // Perform one step or pause of the command in execution
+  void isr() {
+    StepperQueue *q = &fas_queue[0];
+    struct queue_entry *e = &q->entry[q->read_idx & QUEUE_LEN_MASK];
+    if (e->steps > 0) {
+      e->steps--;
+      pos += e->countUp ? 1 : -1;
+    }
+    if (e->steps == 0) {
+      q->_testNextCommand();
+    }
+  }
+
+  void run(uint32_t max_steps) {
+    for (uint32_t i = 0; i < max_steps; i++) {
+      s.fill_queue();
+      if (s.isQueueEmpty()) {
+        break;
+      }
+      isr();
+      check();
+    }
+  }
+
+  void moves() {
+    puts("Test moves");
+    init();
+    check();
+    s.setSpeedInUs(100);
+    s.setAcceleration(100000);
+    s.moveTo(2000);
+    run(1000);
+    // reverse while running
+    s.moveTo(-500);
+    run(100000);
+    test(!s.isRampGeneratorActive(), "ramp not finished");
+    test(pos == -500, "target not reached");
+    check();
+  }
+
+  void set_position() {
+    puts("Test setCurrentPosition");
+    init();
+    s.setSpeedInUs(100);
+    s.setAcceleration(100000);
+    s.moveTo(3000);
+    run(1000);
+    s.setCurrentPosition(10000);
+    // performed steps are preserved, so the offset applies to the counted
+    // position, too.
+    pos = s.getCurrentPosition();
+    test(pos == 10000, "position not set");
+    run(100000);
+    test(pos == 12000, "target not shifted");
+    check();
+
+    s.setPositionAfterCommandsCompleted(-100);
+    pos = -100;
+    check();
+  }
+
+  void force_stop() {
+    puts("Test forceStopAndNewPosition");
+    init();
+    s.setSpeedInUs(100);
+    s.setAcceleration(100000);
+    s.moveTo(3000);
+    run(500);
+    s.forceStopAndNewPosition(42);
+    test(s.isQueueEmpty(), "queue not emptied");
+    pos = 42;
+    check();
+    s.moveTo(-42);
+    run(100000);
+    test(pos == -42, "target not reached");
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  printf("FAS_POSITION_COUNTER=%d\n", FAS_POSITION_COUNTER);
+  test.moves();
+  test.set_position();
+  test.force_stop();
+  printf("%u position checks\n", test.checks);
+  printf("TEST_22 PASSED\n");
+  return 0;
+}
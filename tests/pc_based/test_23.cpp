@@ -0,0 +1,110 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <thread>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+// Stress test of the single producer/single consumer protocol of the command
+// queue. noInterrupts() is a no-op here, so only the acquire/release accesses
+// to read_idx/next_write_idx protect the entries.
+//
+// The producer thread adds commands with addQueueEntry() as fast as the queue
+// allows. The consumer thread emulates the ISR and checks, that every
+// command arrives exactly once, in order and unmodified.
+#define COMMANDS 2000000
+
+static FastAccelStepper s;
+
+static void make_command(uint32_t seq, struct stepper_command_s *cmd) {
+  cmd->steps = 1 + (seq % 251);
+  cmd->ticks = 3200 + (seq % 60000);
+  cmd->count_up = ((seq / 7) & 1) == 0;
+}
+
+static void producer() {
+  struct stepper_command_s cmd;
+  uint32_t seq = 0;
+  uint32_t full = 0;
+  while (seq < COMMANDS) {
+    make_command(seq, &cmd);
+    int8_t res = s.addQueueEntry(&cmd);
+    if (res == AQE_QUEUE_FULL) {
+      full++;
+      std::this_thread::yield();
+      continue;
+    }
+    test(res == AQE_OK, "unexpected addQueueEntry result");
+    seq++;
+  }
+  printf("producer: %u commands, %u retries on full queue\n", seq, full);
+}
+
+static void consumer() {
+  StepperQueue *q = &fas_queue[0];
+  struct stepper_command_s cmd;
+  uint32_t seq = 0;
+  uint32_t empty = 0;
+  bool count_up = true;
+  while (seq < COMMANDS) {
+    queue_idx_t rp = q->read_idx;
+    if (rp == QUEUE_IDX_LOAD(q->next_write_idx)) {
+      empty++;
+      std::this_thread::yield();
+      continue;
+    }
+    struct queue_entry *e = &q->entry[rp & QUEUE_LEN_MASK];
+    make_command(seq, &cmd);
+    test(e->steps == cmd.steps, "steps mismatch");
+    test(e->ticks == cmd.ticks, "ticks mismatch");
+    test(e->countUp == (cmd.count_up ? 1 : 0), "direction mismatch");
+    // Without toggle the direction pin has been set for an empty queue
+    if (e->toggle_dir) {
+      test(count_up != cmd.count_up, "toggle_dir without direction change");
+    }
+    count_up = cmd.count_up;
+    // entry is done and can be overwritten by the producer
+    QUEUE_IDX_STORE(q->read_idx, rp + 1);
+    seq++;
+  }
+  printf("consumer: %u commands, %u polls on empty queue\n", seq, empty);
+}
+
+int main() {
+  fas_queue[0].read_idx = 0;
+  fas_queue[0].next_write_idx = 0;
+  s.init(NULL, 0, 0);
+  s.setDirectionPin(0);
+
+  std::thread c(consumer);
+  std::thread p(producer);
+  p.join();
+  c.join();
+  test(s.isQueueEmpty(), "queue not empty");
+
+  int32_t pos = 0;
+  struct stepper_command_s cmd;
+  for (uint32_t seq = 0; seq < COMMANDS; seq++) {
+    make_command(seq, &cmd);
+    pos += cmd.count_up ? cmd.steps : -cmd.steps;
+  }
+  test(s.getPositionAfterCommandsCompleted() == pos, "position mismatch");
+  printf("TEST_23 PASSED\n");
+  return 0;
+}
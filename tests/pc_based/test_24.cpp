@@ -0,0 +1,150 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+// addQueueEntries() on stepper 0 must give the same queue as addQueueEntry()
+// for each command on stepper 1.
+#define N_CMDS 40
+
+class FastAccelStepperTest {
+ public:
+  FastAccelStepper s[2];
+  struct stepper_command_s cmds[N_CMDS];
+  // position counted by the emulated ISR of stepper 0
+  int32_t pos;
+
+  void init() {
+    for (uint8_t i = 0; i < 2; i++) {
+      fas_queue[i].read_idx = 0;
+      fas_queue[i].next_write_idx = 0;
+      s[i] = FastAccelStepper();
+      s[i].init(NULL, i, i);
+      s[i].setDirectionPin(10 + i);
+    }
+    for (uint8_t i = 0; i < N_CMDS; i++) {
+      cmds[i].ticks = 4000 + 100 * i;
+      cmds[i].steps = i % 5;
+      cmds[i].count_up = (i % 3) != 0;
+    }
+    pos = 0;
+  }
+
+  void compare() {
+    StepperQueue *q0 = &fas_queue[0];
+    StepperQueue *q1 = &fas_queue[1];
+    test(q0->queueEntries() == q1->queueEntries(), "entries differ");
+    for (queue_idx_t i = 0; i < q0->queueEntries(); i++) {
+      struct queue_entry *e0 = &q0->entry[(q0->read_idx + i) & QUEUE_LEN_MASK];
+      struct queue_entry *e1 = &q1->entry[(q1->read_idx + i) & QUEUE_LEN_MASK];
+      test(memcmp(e0, e1, sizeof(struct queue_entry)) == 0, "entry differs");
+    }
+    test(q0->queue_end.pos == q1->queue_end.pos, "position differs");
+    test(q0->queue_end.dir == q1->queue_end.dir, "direction differs");
+    test(q0->ticksInQueue() == q1->ticksInQueue(), "ticks differ");
+  }
+
+  // consume one command of both steppers. Stepper 0 like an ISR
+  void consume() {
+    StepperQueue *q = &fas_queue[0];
+    struct queue_entry *e = &q->entry[q->read_idx & QUEUE_LEN_MASK];
+    pos += e->countUp ? e->steps : -e->steps;
+    e->steps = 0;
+    q->_testNextCommand();
+    test(s[0].getCurrentPosition() == pos, "position mismatch");
+    fas_queue[1]._testNextCommand();
+  }
+
+  void batch() {
+    puts("Test batch");
+    init();
+    test(s[0].addQueueEntries(cmds, 0) == 0, "empty batch");
+    uint16_t added = s[0].addQueueEntries(cmds, N_CMDS);
+    printf("added %u of %u commands\n", added, N_CMDS);
+    test(added == min(QUEUE_LEN, N_CMDS), "queue not filled");
+    for (uint16_t i = 0; i < added; i++) {
+      test(s[1].addQueueEntry(&cmds[i]) == AQE_OK, "command rejected");
+    }
+    compare();
+    test(s[0].addQueueEntries(&cmds[added], N_CMDS - added) == 0,
+         "full queue accepts");
+
+    // continue streaming the remaining commands in parts
+    uint16_t done = added;
+    while (done < N_CMDS) {
+      for (uint8_t i = 0; i < 3; i++) {
+        consume();
+      }
+      added = s[0].addQueueEntries(&cmds[done], N_CMDS - done);
+      test(added == min(3, N_CMDS - done), "free entries not used");
+      for (uint16_t i = 0; i < added; i++) {
+        test(s[1].addQueueEntry(&cmds[done + i]) == AQE_OK,
+             "command rejected");
+      }
+      done += added;
+      compare();
+    }
+    while (!s[0].isQueueEmpty()) {
+      consume();
+    }
+    test(pos == s[0].getPositionAfterCommandsCompleted(), "final position");
+
+    // the queue has run empty, so the position counter restarts
+    added = s[0].addQueueEntries(cmds, 5);
+    test(added == 5, "batch into empty queue");
+    for (uint16_t i = 0; i < added; i++) {
+      s[1].addQueueEntry(&cmds[i]);
+    }
+    compare();
+    test(s[0].getCurrentPosition() == pos, "position after restart");
+    while (!s[0].isQueueEmpty()) {
+      consume();
+    }
+  }
+
+  void invalid() {
+    puts("Test invalid commands");
+    init();
+    cmds[3].ticks = 100;
+    test(s[0].addQueueEntries(cmds, 10) == 3, "too short command accepted");
+    test(s[0].addQueueEntry(&cmds[3]) == AQE_ERROR_TICKS_TOO_LOW,
+         "wrong error");
+    // too short command as first one
+    test(s[0].addQueueEntries(&cmds[3], 10) == 0, "first command accepted");
+    cmds[3].ticks = 4000;
+    cmds[5].steps = 1;
+    cmds[5].ticks = 3000;
+    test(s[0].addQueueEntries(&cmds[3], 10) == 2,
+         "too short command time accepted");
+
+    init();
+    s[0].setDirectionPin(PIN_UNDEFINED);
+    test(s[0].addQueueEntries(&cmds[1], 10) == 2,
+         "negative direction without direction pin accepted");
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  test.batch();
+  test.invalid();
+  printf("TEST_24 PASSED\n");
+  return 0;
+}
@@ -0,0 +1,152 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+// Steps per command are limited by MAX_CMD_STEPS. Passes with
+// FAS_EXTENDED_STEPS=0 and 1
+class FastAccelStepperTest {
+ public:
+  FastAccelStepper s;
+
+  void init() {
+    fas_queue[0].read_idx = 0;
+    fas_queue[0].next_write_idx = 0;
+    s = FastAccelStepper();
+    s.init(NULL, 0, 0);
+    s.setDirectionPin(0);
+  }
+
+  void queue_entry() {
+    puts("Test queue entry");
+    init();
+    struct stepper_command_s cmd = {
+        .ticks = MIN_DELTA_TICKS, .steps = MAX_CMD_STEPS, .count_up = true};
+    test(s.addQueueEntry(&cmd) == AQE_OK, "max steps rejected");
+    struct queue_entry *e = &fas_queue[0].entry[0];
+    test(e->steps == MAX_CMD_STEPS, "steps truncated");
+    test(e->moreThanOneStep == 1, "moreThanOneStep");
+    cmd.count_up = false;
+    test(s.addQueueEntry(&cmd) == AQE_OK, "max steps rejected");
+    uint32_t ticks = (uint32_t)MAX_CMD_STEPS * MIN_DELTA_TICKS;
+    test(fas_queue[0].ticksInQueue() == ticks, "ticks in queue");
+    test(s.getPositionAfterCommandsCompleted() == 0, "position");
+    fas_queue[0]._testNextCommand();
+    test(s.getCurrentPosition() == MAX_CMD_STEPS, "current position");
+#if (FAS_EXTENDED_STEPS == 1)
+    // 16 bit steps above MAX_CMD_STEPS exceed the pulse counter limit
+    cmd.steps = MAX_CMD_STEPS + 1;
+    test(s.addQueueEntry(&cmd) == AQE_ERROR_STEPS_TOO_HIGH,
+         "too many steps accepted");
+    cmd.steps = 40000;
+    test(s.addQueueEntry(&cmd) == AQE_ERROR_STEPS_TOO_HIGH,
+         "too many steps accepted");
+    test(s.getPositionAfterCommandsCompleted() == 0, "rejected steps counted");
+#endif
+  }
+
+  // Long coasting at high speed with long command duration
+  void coast() {
+    puts("Test coast");
+    init();
+    test(s.setCommandDurationInUs(20000) == 0, "duration rejected");
+    s.setSpeedInUs(20);
+    s.setAcceleration(100000);
+    s.moveTo(500000);
+    uint32_t commands = 0;
+    uint32_t max_steps = 0;
+    int32_t pos = 0;
+    while (true) {
+      s.fill_queue();
+      if (s.isQueueEmpty()) {
+        break;
+      }
+      struct queue_entry *e =
+          &fas_queue[0].entry[fas_queue[0].read_idx & QUEUE_LEN_MASK];
+      test(e->steps <= MAX_CMD_STEPS, "too many steps");
+      max_steps = max(max_steps, e->steps);
+      pos += e->countUp ? e->steps : -e->steps;
+      fas_queue[0]._testNextCommand();
+      commands++;
+    }
+    test(!s.isRampGeneratorActive(), "move not finished");
+    test(pos == 500000, "target not reached");
+    printf("%u commands, max %u steps per command\n", commands, max_steps);
+#if (FAS_EXTENDED_STEPS == 1)
+    // approx. 1000 steps per command during coasting
+    test(max_steps > 255, "extended steps not used");
+    test(commands < 1000, "too many commands");
+#else
+    test(max_steps == 255, "steps not limited");
+    test(commands > 1800, "too few commands");
+#endif
+  }
+
+  // Coordinated move with long commands: the command steps times the steps
+  // of the slave exceed 32 bit with extended steps
+  void coordinated() {
+    puts("Test coordinated");
+    init();
+    fas_queue[1].read_idx = 0;
+    fas_queue[1].next_write_idx = 0;
+    FastAccelStepper slave = FastAccelStepper();
+    slave.init(NULL, 1, 1);
+    test(s.setCommandDurationInUs(20000) == 0, "duration rejected");
+    FastAccelStepper *steppers[2] = {&s, &slave};
+    for (uint8_t i = 0; i < 2; i++) {
+      steppers[i]->setSpeedInUs(20);
+      steppers[i]->setAcceleration(100000);
+    }
+    FastAccelStepperEngine engine;
+    int32_t positions[2] = {0xffffff, 0x7fffff};
+    test(engine.moveToCoordinated(steppers, positions, 2) == MOVE_OK,
+         "coordinated move rejected");
+    int32_t pos[2] = {0, 0};
+    uint32_t max_steps = 0;
+    while (s.isRampGeneratorActive() || (s._coord_slaves != 0)) {
+      s.fill_queue();
+      for (uint8_t q = 0; q < 2; q++) {
+        while (!fas_queue[q].isQueueEmpty()) {
+          struct queue_entry *e =
+              &fas_queue[q].entry[fas_queue[q].read_idx & QUEUE_LEN_MASK];
+          max_steps = max(max_steps, e->steps);
+          pos[q] += e->steps;
+          fas_queue[q]._testNextCommand();
+        }
+      }
+      // the slave follows within the pending steps of one command
+      int32_t dev = pos[1] - pos[0] / 2;
+      test(abs(dev) <= 2 * MAX_CMD_STEPS, "slave does not follow");
+    }
+    printf("max %u steps per command\n", max_steps);
+    test(pos[0] == positions[0], "master not at target");
+    test(pos[1] == positions[1], "slave not at target");
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  printf("FAS_EXTENDED_STEPS=%d MAX_CMD_STEPS=%d entry size=%d\n",
+         FAS_EXTENDED_STEPS, MAX_CMD_STEPS, (int)sizeof(struct queue_entry));
+  test.queue_entry();
+  test.coast();
+  test.coordinated();
+  printf("TEST_25 PASSED\n");
+  return 0;
+}
@@ -0,0 +1,151 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+#define TICKS_PER_MS 16000
+
+// Queue statistics for fill_queue() called in time and too late
+class FastAccelStepperTest {
+ public:
+  FastAccelStepper s;
+  uint64_t time;
+  // queue ran empty while the ramp generator has been active
+  uint32_t underruns;
+
+  void init() {
+    fas_queue[0].read_idx = 0;
+    fas_queue[0].next_write_idx = 0;
+    fas_queue[0]._isRunning = false;
+    s = FastAccelStepper();
+    s.init(NULL, 0, 0);
+    time = 0;
+    underruns = 0;
+  }
+
+  void process_entry() {
+    struct queue_entry *e =
+        &fas_queue[0].entry[fas_queue[0].read_idx & QUEUE_LEN_MASK];
+    if (e->steps == 0) {
+      time += e->ticks;
+    }
+    time += (uint64_t)e->ticks * e->steps;
+    fas_queue[0]._testNextCommand();
+    if (s.isQueueEmpty()) {
+      fas_queue[0]._isRunning = false;
+      if (s.isRampGeneratorActive()) {
+        underruns++;
+      }
+    }
+  }
+
+  // Execute the queue in real time, while fill_queue() is called every
+  // period_ms till end_ms
+  void run(uint32_t period_ms, uint32_t end_ms) {
+    uint64_t next_fill = time;
+    uint64_t end = (uint64_t)end_ms * TICKS_PER_MS;
+    while (time < end) {
+      while (!s.isQueueEmpty() && (time < next_fill)) {
+        process_entry();
+      }
+      if (time < next_fill) {
+        // idle
+        time = next_fill;
+      }
+      s.fill_queue();
+      if (!s.isQueueEmpty()) {
+        fas_queue[0]._isRunning = true;
+      }
+      next_fill += (uint64_t)period_ms * TICKS_PER_MS;
+    }
+  }
+
+  void print(struct queue_stats_s *stats) {
+    printf("fills=%u underruns=%u min_lead_ticks=%u\n", stats->fills,
+           stats->underruns, stats->min_lead_ticks);
+  }
+
+  void in_time() {
+    puts("Test fill in time");
+    init();
+    struct queue_stats_s stats;
+    s.getQueueStats(&stats);
+    test(stats.fills == 0, "fills after init");
+    test(stats.underruns == 0, "underruns after init");
+    test(stats.min_lead_ticks == 0xffffffff, "lead after init");
+    s.setSpeedInUs(50);
+    s.setAcceleration(100000);
+    s.moveTo(20000);
+    run(1, 2000);
+    test(!s.isRampGeneratorActive(), "move not finished");
+    s.getQueueStats(&stats);
+    print(&stats);
+    test(underruns == 0, "queue underrun");
+    test(stats.underruns == 0, "underrun counted");
+    test(stats.fills > 900, "fills not counted");
+    // lookahead is 20ms minus one fill period minus the command in execution
+    test(stats.min_lead_ticks > 10 * TICKS_PER_MS, "lead too short");
+    test(stats.min_lead_ticks < 20 * TICKS_PER_MS, "lead too long");
+
+    // no update for the stopped stepper
+    run(1, 2100);
+    struct queue_stats_s stats2;
+    s.getQueueStats(&stats2);
+    test(stats2.fills == stats.fills, "fills counted for stopped stepper");
+  }
+
+  void too_late() {
+    puts("Test fill too late");
+    init();
+    s.setSpeedInUs(50);
+    s.setAcceleration(100000);
+    s.runForward();
+    run(30, 1000);
+    struct queue_stats_s stats;
+    s.getQueueStats(&stats);
+    print(&stats);
+    test(underruns > 0, "expected underruns");
+    test(stats.underruns == underruns, "underruns not counted");
+    test(stats.min_lead_ticks == 0, "lead of underrun");
+
+    // with long enough lookahead no more underruns after the next fill. The
+    // queue can hold the lookahead only with longer commands
+    s.setLookAheadInMs(50, 50);
+    s.setCommandDurationInUs(4000);
+    run(30, 1100);
+    s.resetQueueStats();
+    s.getQueueStats(&stats);
+    test(stats.fills == 0, "fills after reset");
+    test(stats.underruns == 0, "underruns after reset");
+    test(stats.min_lead_ticks == 0xffffffff, "lead after reset");
+    run(30, 2000);
+    s.getQueueStats(&stats);
+    print(&stats);
+    test(stats.underruns == 0, "underruns with long lookahead");
+    test(stats.min_lead_ticks > 10 * TICKS_PER_MS, "lead with long lookahead");
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  test.in_time();
+  test.too_late();
+  printf("TEST_26 PASSED\n");
+  return 0;
+}
@@ -0,0 +1,126 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+FastAccelStepperEngine engine;
+extern bool fas_test_prepared_is_running;
+
+// Prepared queues are started with FastAccelStepperEngine::startQueues().
+// The stub starts the selected queues by setting _isRunning. Like on esp32,
+// prepared queues can report isRunning() before they are started.
+class FastAccelStepperTest {
+ public:
+  FastAccelStepper *s[2];
+
+  void init() {
+    engine.init();
+    s[0] = engine.stepperConnectToPin(0);
+    s[1] = engine.stepperConnectToPin(1);
+    test(s[0] != NULL, "no stepper 0");
+    test(s[1] != NULL, "no stepper 1");
+    // the direction pin of a running stepper is busy for the other one
+    s[0]->setDirectionPin(10);
+    s[1]->setDirectionPin(11);
+  }
+
+  bool running(uint8_t i) { return fas_queue[i].isRunning(); }
+  bool started(uint8_t i) { return fas_queue[i]._isStarted(); }
+
+  void prepare(uint8_t i) {
+    struct stepper_command_s cmd = {
+        .ticks = 4000, .steps = 3, .count_up = true};
+    test(s[i]->addQueueEntry(&cmd, false) == AQE_OK, "command rejected");
+    test(s[i]->addQueueEntry(&cmd, false) == AQE_OK, "command rejected");
+  }
+
+  void stop() {
+    for (uint8_t i = 0; i < 2; i++) {
+      s[i]->forceStopAndNewPosition(0);
+      fas_queue[i].forceStop();
+    }
+  }
+
+  void start() {
+    puts("Test startQueues");
+    prepare(0);
+    prepare(1);
+    test(!running(0) && !running(1), "started too early");
+    test(engine.startQueues(0x03) == AQE_OK, "start failed");
+    test(running(0) && running(1), "not started");
+    stop();
+
+    // selected empty queue: none is started
+    prepare(0);
+    test(engine.startQueues(0x03) == AQE_ERROR_EMPTY_QUEUE_TO_START,
+         "empty queue started");
+    test(!running(0), "started with empty queue");
+    test(engine.startQueues(0x01) == AQE_OK, "start failed");
+    test(running(0) && !running(1), "wrong stepper started");
+
+    // not connected steppers are ignored
+    test(engine.startQueues(0x80) == AQE_OK, "not connected stepper");
+    stop();
+  }
+
+  void start_prepared_is_running() {
+    puts("Test startQueues with prepared queues reported as running");
+    fas_test_prepared_is_running = true;
+    prepare(0);
+    prepare(1);
+    test(running(0) && running(1), "prepared queues not reported as running");
+    test(!started(0) && !started(1), "started too early");
+    test(engine.startQueues(0x03) == AQE_OK, "start failed");
+    test(started(0) && started(1), "not started");
+    stop();
+    fas_test_prepared_is_running = false;
+  }
+
+  void coordinated(bool prepared_is_running) {
+    printf("Test coordinated start, prepared queues %s\n",
+           prepared_is_running ? "running" : "not running");
+    fas_test_prepared_is_running = prepared_is_running;
+    s[0]->setSpeedInUs(100);
+    s[0]->setAcceleration(10000);
+    s[1]->setSpeedInUs(100);
+    s[1]->setAcceleration(10000);
+    int32_t positions[2] = {1000, 500};
+    test(engine.moveToCoordinated(s, positions, 2) == MOVE_OK,
+         "coordinated move rejected");
+    test(!started(0) && !started(1), "started too early");
+    // the first fill prepares both queues and starts them together
+    s[0]->fill_queue();
+    test(!s[0]->isQueueEmpty() && !s[1]->isQueueEmpty(), "queues not filled");
+    test(started(0) && started(1), "not started together");
+    test(running(0) && running(1), "not running");
+    stop();
+    fas_test_prepared_is_running = false;
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  test.init();
+  test.start();
+  test.start_prepared_is_running();
+  test.coordinated(false);
+  test.coordinated(true);
+  printf("TEST_27 PASSED\n");
+  return 0;
+}
@@ -0,0 +1,140 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+// Repeated pauses are checked with an ISR emulation like on avr
+class FastAccelStepperTest {
+ public:
+  FastAccelStepper s;
+
+  void init() {
+    fas_queue[0].read_idx = 0;
+    fas_queue[0].next_write_idx = 0;
+    s = FastAccelStepper();
+    s.init(NULL, 0, 0);
+    s.setDirectionPin(0);
+  }
+
+  // Execute the queue and return the time in ticks
+  uint64_t run() {
+    StepperQueue *q = &fas_queue[0];
+    uint64_t time = 0;
+    while (!q->isQueueEmpty()) {
+      struct queue_entry *e = &q->entry[q->read_idx & QUEUE_LEN_MASK];
+      time += e->ticks;
+      if (e->steps > 1) {
+        e->steps--;
+        continue;
+      }
+      if (e->repeat != 0) {
+        e->repeat--;
+        continue;
+      }
+      q->_testNextCommand();
+    }
+    return time;
+  }
+
+  void repeated_pause() {
+    puts("Test repeated pause");
+    init();
+    struct stepper_command_s step = {
+        .ticks = 4000, .steps = 10, .count_up = true};
+    test(s.addQueueEntry(&step) == AQE_OK, "step rejected");
+    test(s.addRepeatedPause(50000, MAX_PAUSE_REPEAT) == AQE_OK,
+         "pause rejected");
+    test(s.addQueueEntry(&step) == AQE_OK, "step rejected");
+    test(fas_queue[0].queueEntries() == 3, "pause needs more entries");
+    uint32_t pause = 50000 * (MAX_PAUSE_REPEAT + 1);
+    test(fas_queue[0].ticksInQueue() == pause + 40000, "ticks in queue");
+    test(s.getPositionAfterCommandsCompleted() == 20, "position");
+    uint64_t time = run();
+    printf("queue executed in %u ticks\n", (uint32_t)time);
+    test(time == 80000 + pause, "pause duration");
+  }
+
+  void invalid() {
+    puts("Test invalid repeat");
+    init();
+#if (MAX_PAUSE_REPEAT < 255)
+    test(s.addRepeatedPause(50000, MAX_PAUSE_REPEAT + 1) ==
+             AQE_ERROR_INVALID_REPEAT,
+         "repeat too high");
+#endif
+    test(s.addRepeatedPause(MIN_CMD_TICKS - 1, 3) == AQE_ERROR_TICKS_TOO_LOW,
+         "too short pause");
+    struct stepper_command_s step = {
+        .ticks = 4000, .steps = 10, .count_up = true};
+    test(fas_queue[0].addQueueEntry(&step, true, 1) == AQE_ERROR_INVALID_REPEAT,
+         "steps repeated");
+    test(fas_queue[0].isQueueEmpty(), "invalid entry added");
+  }
+
+  // auto enable uses a repeated pause for the delay to enable. The limit of
+  // setDelayToEnable() depends on QUEUE_LEN, so longer delays are set
+  // directly
+  void delay_to_enable(uint32_t delay_us, bool direct = false) {
+    printf("Test delay to enable %uus\n", delay_us);
+    init();
+    s.setEnablePin(5);
+    s.setAutoEnable(true);
+    if (direct) {
+      s._on_delay_ticks = US_TO_TICKS(delay_us);
+    } else {
+      test(s.setDelayToEnable(delay_us) == DELAY_OK, "delay rejected");
+    }
+    struct stepper_command_s step = {
+        .ticks = 4000, .steps = 1, .count_up = true};
+    test(s.addQueueEntry(&step) == AQE_OK, "step rejected");
+    StepperQueue *q = &fas_queue[0];
+    uint32_t pause = 0;
+    queue_idx_t entries = q->queueEntries();
+    for (queue_idx_t i = 0; i < entries - 1; i++) {
+      struct queue_entry *e = &q->entry[(q->read_idx + i) & QUEUE_LEN_MASK];
+      test(e->steps == 0, "pause expected");
+      test(e->ticks >= MIN_CMD_TICKS, "pause too short");
+      pause += e->ticks * (e->repeat + 1);
+    }
+    uint32_t delay = US_TO_TICKS(delay_us);
+    printf("%u entries for delay of %u ticks: %u ticks\n", entries - 1,
+           delay, pause);
+    test(pause >= delay, "delay too short");
+    test(pause < delay + MAX_PAUSE_REPEAT + 1, "delay too long");
+    // each entry covers up to MAX_PAUSE_REPEAT + 1 pauses of 65535 ticks
+    uint32_t max_entry_ticks = (uint32_t)65535 * (MAX_PAUSE_REPEAT + 1);
+    test(entries - 1 == (delay + max_entry_ticks - 1) / max_entry_ticks,
+         "too many entries for delay");
+    test(run() == pause + 4000, "queue time");
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  test.repeated_pause();
+  test.invalid();
+  test.delay_to_enable(1000);
+  test.delay_to_enable(50000);
+  test.delay_to_enable(TICKS_TO_US(MAX_ON_DELAY_TICKS));
+  // two entries with MAX_PAUSE_REPEAT
+  test.delay_to_enable(
+      TICKS_TO_US((uint32_t)65535 * (MAX_PAUSE_REPEAT + 1) * 2), true);
+  printf("TEST_28 PASSED\n");
+  return 0;
+}
@@ -0,0 +1,136 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+// Marker events are checked with an ISR emulation like on avr
+class FastAccelStepperTest {
+ public:
+  FastAccelStepper s;
+  int32_t pos;
+
+  void init() {
+    fas_queue[0].read_idx = 0;
+    fas_queue[0].next_write_idx = 0;
+    s = FastAccelStepper();
+    s.init(NULL, 0, 0);
+    s.setDirectionPin(0);
+    pos = 0;
+  }
+
+  void add_steps(uint8_t steps) {
+    struct stepper_command_s cmd = {
+        .ticks = 4000, .steps = steps, .count_up = true};
+    test(s.addQueueEntry(&cmd) == AQE_OK, "step rejected");
+  }
+
+  // Execute one entry of the queue and advance to the next one
+  void isr() {
+    StepperQueue *q = &fas_queue[0];
+    struct queue_entry *e = &q->entry[q->read_idx & QUEUE_LEN_MASK];
+    pos += e->countUp ? e->steps : -e->steps;
+    q->_testNextCommand();
+  }
+
+  void markers() {
+    puts("Test markers");
+    init();
+    test(s.getMarkerEvent() == 0, "event without marker");
+    add_steps(10);
+    test(s.addMarker(1) == AQE_OK, "marker rejected");
+    add_steps(5);
+    test(s.addMarker(2, 10000) == AQE_OK, "marker rejected");
+    // ticks of the entry in execution are not counted
+    test(fas_queue[0].ticksInQueue() == MIN_CMD_TICKS + 20000 + 10000,
+         "ticks in queue");
+    test(s.getPositionAfterCommandsCompleted() == 15, "position");
+
+    test(s.getMarkerEvent() == 0, "event for steps");
+    isr();
+    // all steps in front of the marker are done and the marker is current
+    test(pos == 10, "steps not done");
+    test(s.getMarkerEvent() == 1, "marker 1 not reported");
+    test(s.getMarkerEvent() == 0, "marker reported twice");
+    isr();
+    test(s.getMarkerEvent() == 0, "event for steps");
+    while (!s.isQueueEmpty()) {
+      isr();
+    }
+    test(s.getMarkerEvent() == 2, "marker 2 not reported");
+    test(s.getMarkerEvent() == 0, "too many events");
+    test(s.getLostMarkerEvents() == 0, "lost markers");
+
+    // Entries reusing the slots of the markers have no tag
+    for (uint16_t i = 0; i < QUEUE_LEN; i++) {
+      add_steps(1);
+      isr();
+    }
+    test(s.getMarkerEvent() == 0, "event for reused entry");
+  }
+
+  void lost() {
+    puts("Test lost markers");
+    init();
+    uint8_t n = min(QUEUE_LEN, MARKER_EVENTS + 2);
+    for (uint8_t i = 1; i <= n; i++) {
+      test(s.addMarker(i) == AQE_OK, "marker rejected");
+    }
+    while (!s.isQueueEmpty()) {
+      isr();
+    }
+    uint8_t expected = min(n, MARKER_EVENTS);
+    test(s.getLostMarkerEvents() == n - expected, "lost markers not counted");
+    for (uint8_t i = 1; i <= expected; i++) {
+      test(s.getMarkerEvent() == i, "wrong order");
+    }
+    test(s.getMarkerEvent() == 0, "too many events");
+  }
+
+  void first() {
+    puts("Test marker added to empty queue");
+    init();
+    // no steps in front, so the marker is current at once
+    test(s.addMarker(3) == AQE_OK, "marker rejected");
+    test(s.getMarkerEvent() == 3, "marker of empty queue not reported");
+    add_steps(1);
+    while (!s.isQueueEmpty()) {
+      isr();
+    }
+    test(s.getMarkerEvent() == 0, "marker reported twice");
+  }
+
+  void invalid() {
+    puts("Test invalid marker");
+    init();
+    test(s.addMarker(0) == AQE_ERROR_INVALID_TAG, "tag 0 accepted");
+    test(s.addMarker(1, MIN_CMD_TICKS - 1) == AQE_ERROR_TICKS_TOO_LOW,
+         "too short marker");
+    test(s.isQueueEmpty(), "invalid marker added");
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  test.markers();
+  test.lost();
+  test.first();
+  test.invalid();
+  printf("TEST_29 PASSED\n");
+  return 0;
+}
@@ -0,0 +1,166 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+#include "StepperISR_host.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+// Complete moves are executed by the virtual time backend, which calls
+// manageSteppers() every 4ms and executes the queues like the avr ISR. The
+// steps are counted from the pin edges.
+#define STEP_PIN(i) (1 + (i))
+#define DIR_PIN(i) (3 + (i))
+#define ENABLE_PIN 5
+
+FastAccelStepperEngine engine;
+
+struct pin_trace_s {
+  int32_t pos;
+  uint64_t first_step;
+  uint64_t last_step;
+  uint64_t min_period;
+  uint32_t steps_disabled;
+} trace[2];
+uint64_t last_edge;
+
+static void edge(uint64_t ticks, uint8_t pin, uint8_t level) {
+  test(ticks >= last_edge, "edges out of order");
+  last_edge = ticks;
+  for (uint8_t i = 0; i < 2; i++) {
+    struct pin_trace_s *t = &trace[i];
+    if ((pin == STEP_PIN(i)) && level) {
+      if (t->first_step == 0) {
+        t->first_step = ticks;
+      } else if (ticks - t->last_step < t->min_period) {
+        t->min_period = ticks - t->last_step;
+      }
+      t->last_step = ticks;
+      t->pos += fas_host_pin_level(DIR_PIN(i)) ? 1 : -1;
+      // enable pin is low active
+      if (fas_host_pin_level(ENABLE_PIN)) {
+        t->steps_disabled++;
+      }
+    }
+  }
+}
+
+class FastAccelStepperTest {
+ public:
+  FastAccelStepper *s[2];
+
+  void init() {
+    fas_host_init(&engine);
+    fas_host_set_edge_callback(edge);
+    last_edge = 0;
+    for (uint8_t i = 0; i < 2; i++) {
+      s[i]->setDirectionPin(DIR_PIN(i));
+      s[i]->setEnablePin(ENABLE_PIN);
+      s[i]->setAutoEnable(true);
+      s[i]->setCurrentPosition(0);
+      trace[i].pos = 0;
+      trace[i].first_step = 0;
+      trace[i].last_step = 0;
+      trace[i].min_period = 0xffffffff;
+      trace[i].steps_disabled = 0;
+    }
+  }
+
+  void check(uint8_t i, int32_t target) {
+    test(s[i]->getCurrentPosition() == target, "target not reached");
+    test(trace[i].pos == target, "step and dir edges do not match position");
+    test(trace[i].steps_disabled == 0, "step with disabled stepper");
+  }
+
+  void move() {
+    puts("Test move");
+    init();
+    s[0]->setSpeedInUs(50);
+    s[0]->setAcceleration(100000);
+    s[0]->moveTo(10000);
+    test(fas_host_run_until_idle(TICKS_PER_S * 2), "move not finished");
+    check(0, 10000);
+    struct fas_host_stats_s stats;
+    fas_host_get_stats(&stats);
+    test(stats.steps[0] == 10000, "steps counted");
+    test(stats.steps[1] == 0, "steps of stepper 1");
+    uint64_t duration = trace[0].last_step - trace[0].first_step;
+    uint32_t duration_us = TICKS_TO_US(duration);
+    printf("first step after %uus, move in %uus, min period %u ticks\n",
+           (uint32_t)TICKS_TO_US(trace[0].first_step), duration_us,
+           (uint32_t)trace[0].min_period);
+    // The first fill is done by the cyclic task
+    test(trace[0].first_step <= FAS_HOST_MANAGE_TICKS + US_TO_TICKS(1000),
+         "first step too late");
+    // 0.2s acceleration, 0.3s coasting and 0.2s deceleration
+    test(duration_us > 690000, "move too fast");
+    test(duration_us < 710000, "move too slow");
+    test(trace[0].min_period >= US_TO_TICKS(50) - 1, "speed exceeded");
+    struct queue_stats_s qs;
+    s[0]->getQueueStats(&qs);
+    printf("%u fills, %u underruns, min lead %uus\n", qs.fills, qs.underruns,
+           (uint32_t)TICKS_TO_US(qs.min_lead_ticks));
+    test(qs.underruns == 0, "queue underrun");
+  }
+
+  void reverse() {
+    puts("Test reverse while running");
+    init();
+    s[0]->setSpeedInUs(40);
+    s[0]->setAcceleration(50000);
+    s[0]->moveTo(5000);
+    fas_host_run_until(fas_host_ticks() + TICKS_PER_S / 10);
+    test(s[0]->isRunning(), "not running");
+    s[0]->moveTo(-2000);
+    test(fas_host_run_until_idle(TICKS_PER_S * 2), "move not finished");
+    check(0, -2000);
+  }
+
+  void two_steppers() {
+    puts("Test two steppers");
+    init();
+    s[0]->setSpeedInUs(30);
+    s[0]->setAcceleration(200000);
+    s[1]->setSpeedInUs(100);
+    s[1]->setAcceleration(20000);
+    s[0]->setDelayToDisable(50);
+    s[1]->setDelayToDisable(50);
+    s[0]->moveTo(-7000);
+    s[1]->moveTo(3000);
+    test(fas_host_run_until_idle(TICKS_PER_S * 2), "move not finished");
+    check(0, -7000);
+    check(1, 3000);
+    // auto disable after 50ms
+    test(fas_host_pin_level(ENABLE_PIN) == 0, "disabled too early");
+    fas_host_run_until(fas_host_ticks() + TICKS_PER_S / 10);
+    test(fas_host_pin_level(ENABLE_PIN) == 1, "not disabled");
+  }
+};
+
+int main() {
+  FastAccelStepperTest test;
+  engine.init();
+  for (uint8_t i = 0; i < 2; i++) {
+    test.s[i] = engine.stepperConnectToPin(STEP_PIN(i));
+    test(test.s[i] != NULL, "stepper not connected");
+  }
+  test.move();
+  test.reverse();
+  test.two_steppers();
+  printf("TEST_30 PASSED\n");
+  return 0;
+}
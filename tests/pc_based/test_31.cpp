@@ -0,0 +1,156 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+#include "StepperISR_host.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+// The host run writes test_31.vcd with the signal names of the simavr
+// tests. The trace is read back and evaluated like eval.awk does. The same
+// trace can be evaluated with make vcd.
+#define VCD_FILE "test_31.vcd"
+
+FastAccelStepperEngine engine;
+
+struct signal_s {
+  char code;
+  char name[16];
+  uint8_t state;
+  uint32_t cnt_l_h;
+  uint32_t cnt_h_l;
+  uint64_t time_l_h;
+  uint64_t max_time_h;
+} signals[FAS_HOST_VCD_SIGNALS];
+uint8_t n_signals;
+
+struct signal_s *find(const char *name) {
+  for (uint8_t i = 0; i < n_signals; i++) {
+    if (strcmp(signals[i].name, name) == 0) {
+      return &signals[i];
+    }
+  }
+  test(false, "signal not in trace");
+  return NULL;
+}
+
+// Returns the position of StepA/DirA
+int32_t evaluate() {
+  FILE *f = fopen(VCD_FILE, "r");
+  test(f != NULL, "no trace");
+  char line[100];
+  uint64_t time = 0;
+  uint64_t last_time = 0;
+  int32_t pos = 0;
+  n_signals = 0;
+  while (fgets(line, sizeof(line), f)) {
+    char code;
+    char name[16];
+    if (sscanf(line, "$var wire 1 %c %15s $end", &code, name) == 2) {
+      struct signal_s *s = &signals[n_signals++];
+      memset(s, 0, sizeof(*s));
+      s->code = code;
+      strcpy(s->name, name);
+      s->state = 2;
+    } else if (line[0] == '#') {
+      time = strtoull(&line[1], NULL, 10);
+      test(time >= last_time, "time not increasing");
+      last_time = time;
+    } else if ((line[0] == '0') || (line[0] == '1')) {
+      uint8_t level = line[0] - '0';
+      for (uint8_t i = 0; i < n_signals; i++) {
+        struct signal_s *s = &signals[i];
+        if (s->code != line[1]) {
+          continue;
+        }
+        test(s->state != level, "value change without change");
+        if ((s->state == 0) && (level == 1)) {
+          s->cnt_l_h++;
+          s->time_l_h = time;
+          if (strcmp(s->name, "StepA") == 0) {
+            pos += find("DirA")->state ? 1 : -1;
+          }
+        }
+        if ((s->state == 1) && (level == 0)) {
+          s->cnt_h_l++;
+          if (time - s->time_l_h > s->max_time_h) {
+            s->max_time_h = time - s->time_l_h;
+          }
+        }
+        s->state = level;
+      }
+    }
+  }
+  fclose(f);
+  return pos;
+}
+
+int main() {
+  engine.init();
+  FastAccelStepper *s[2];
+  for (uint8_t i = 0; i < 2; i++) {
+    s[i] = engine.stepperConnectToPin(1 + i);
+    test(s[i] != NULL, "stepper not connected");
+  }
+  fas_host_init(&engine);
+  const char *names[] = {"StepA", "StepB", "DirA",
+                         "DirB",  "EnableA", "EnableB"};
+  for (uint8_t pin = 1; pin <= 6; pin++) {
+    test(fas_host_vcd_add_signal(pin, names[pin - 1]), "signal rejected");
+  }
+  test(!fas_host_vcd_add_signal(1, "Step"), "pin traced twice");
+  for (uint8_t i = 0; i < 2; i++) {
+    s[i]->setDirectionPin(3 + i);
+    s[i]->setEnablePin(5 + i);
+    s[i]->setAutoEnable(true);
+  }
+  test(fas_host_vcd_open(VCD_FILE), "cannot open trace");
+
+  s[0]->setSpeedInUs(100);
+  s[0]->setAcceleration(10000);
+  s[0]->moveTo(3200);
+  test(fas_host_run_until_idle(TICKS_PER_S * 2), "move not finished");
+  s[0]->moveTo(1000);
+  test(fas_host_run_until_idle(TICKS_PER_S * 2), "move not finished");
+  fas_host_run_until(fas_host_ticks() + TICKS_PER_S / 10);
+  fas_host_vcd_close();
+
+  int32_t pos = evaluate();
+  for (uint8_t i = 0; i < n_signals; i++) {
+    struct signal_s *sig = &signals[i];
+    printf("%8s: %8u*L->H, %8u*H->L, Max High=%uus\n", sig->name,
+           sig->cnt_l_h, sig->cnt_h_l,
+           (uint32_t)(sig->max_time_h / FAS_HOST_VCD_REF));
+  }
+  printf("Position[A]=%d\n", pos);
+  struct fas_host_stats_s stats;
+  fas_host_get_stats(&stats);
+  test(pos == 1000, "position from trace");
+  test(find("StepA")->cnt_l_h == stats.steps[0], "steps in trace");
+  test(find("StepA")->cnt_h_l == stats.steps[0], "falling edges in trace");
+  test(find("StepA")->max_time_h ==
+           FAS_HOST_STEP_HIGH_TICKS * FAS_HOST_VCD_PS_PER_TICK,
+       "step high time");
+  test(find("StepB")->cnt_l_h == 0, "steps of B");
+  test(find("DirA")->cnt_h_l == 1, "direction change");
+  test(find("EnableA")->cnt_h_l == 2, "enable");
+  test(find("EnableA")->cnt_l_h == 2, "disable");
+  test(find("EnableB")->cnt_h_l == 0, "enable of B");
+  printf("TEST_31 PASSED\n");
+  return 0;
+}
@@ -0,0 +1,129 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+#include "StepperISR_host.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+// Latency histograms of fill_queue() and the stepper ISR for a move with the
+// virtual time backend. micros() of the pc based tests returns always 0 and
+// the emulated ISR takes no time, so those are all counted in bin 0.
+
+FastAccelStepperEngine engine;
+
+uint32_t sum(const uint16_t* histogram) {
+  uint32_t s = 0;
+  for (uint8_t i = 0; i < LATENCY_BINS; i++) {
+    s += histogram[i];
+  }
+  return s;
+}
+
+void test_bins() {
+  puts("Test bins");
+  test(StepperQueue::_latencyBin(0) == 0, "bin of 0");
+  test(StepperQueue::_latencyBin(1) == 1, "bin of 1");
+  test(StepperQueue::_latencyBin(2) == 2, "bin of 2");
+  test(StepperQueue::_latencyBin(3) == 2, "bin of 3");
+  test(StepperQueue::_latencyBin(4) == 3, "bin of 4");
+  test(StepperQueue::_latencyBin(255) == 8, "bin of 255");
+  test(StepperQueue::_latencyBin(256) == 9, "bin of 256");
+  test(StepperQueue::_latencyBin(16383) == 14, "bin of 16383");
+  test(StepperQueue::_latencyBin(16384) == 15, "bin of 16384");
+  test(StepperQueue::_latencyBin(65535) == 15, "bin of 65535");
+  for (uint16_t v = 1; v < 16384; v++) {
+    uint8_t bin = StepperQueue::_latencyBin(v);
+    test((v >> (bin - 1)) == 1, "value not in bin");
+  }
+}
+
+void test_halving() {
+  puts("Test halving of full histogram");
+  uint16_t h[LATENCY_BINS] = {0};
+  h[3] = 11;
+  for (uint16_t i = 0; i < 0xfffe; i++) {
+    StepperQueue::_latencyAdd(h, 1);
+  }
+  test(h[1] == 0xfffe, "bin 1 before overflow");
+  test(h[3] == 11, "bin 3 before overflow");
+  StepperQueue::_latencyAdd(h, 1);
+  test(h[1] == 0x7fff, "bin 1 not halved");
+  test(h[3] == 5, "bin 3 not halved");
+}
+
+void test_move(FastAccelStepper* s) {
+  puts("Test move");
+  fas_host_init(&engine);
+  s->resetLatencyStats();
+  s->resetQueueStats();
+  s->setSpeedInUs(50);
+  s->setAcceleration(100000);
+  s->moveTo(10000);
+  test(fas_host_run_until_idle(TICKS_PER_S * 2), "move not finished");
+  test(s->getCurrentPosition() == 10000, "target not reached");
+
+  struct latency_stats_s ls;
+  s->getLatencyStats(&ls);
+  struct fas_host_stats_s hs;
+  fas_host_get_stats(&hs);
+  struct queue_stats_s qs;
+  s->getQueueStats(&qs);
+  for (uint8_t i = 0; i < LATENCY_BINS; i++) {
+    printf("bin %2d: fill_us %5u fill_commands %5u isr_ticks %5u\n", i,
+           ls.fill_us[i], ls.fill_commands[i], ls.isr_ticks[i]);
+  }
+  test(ls.isr_ticks[0] == hs.stepper_isr_calls[0], "ISR calls");
+  test(sum(ls.isr_ticks) == ls.isr_ticks[0], "ISR time");
+  test(sum(ls.fill_us) == sum(ls.fill_commands), "fill calls");
+  test(sum(ls.fill_us) == ls.fill_us[0], "fill time");
+  // The first fill is not counted by the queue stats
+  test(sum(ls.fill_commands) >= qs.fills + 1, "fill calls not counted");
+  // The first fill prepares the lookahead of 20ms with about 10 commands or
+  // fills a short queue
+  uint32_t big_fills = 0;
+  for (uint8_t i = StepperQueue::_latencyBin(min(QUEUE_LEN, 8));
+       i < LATENCY_BINS; i++) {
+    big_fills += ls.fill_commands[i];
+  }
+  test(big_fills >= 1, "first fill");
+  test(ls.fill_commands[LATENCY_BINS - 1] == 0, "too many commands");
+
+  s->resetLatencyStats();
+  s->getLatencyStats(&ls);
+  test(sum(ls.fill_us) == 0, "fill_us not reset");
+  test(sum(ls.fill_commands) == 0, "fill_commands not reset");
+  test(sum(ls.isr_ticks) == 0, "isr_ticks not reset");
+}
+
+int main() {
+  engine.init();
+  FastAccelStepper* s[2];
+  for (uint8_t i = 0; i < 2; i++) {
+    s[i] = engine.stepperConnectToPin(1 + i);
+    test(s[i] != NULL, "stepper not connected");
+  }
+  test_bins();
+  test_halving();
+  test_move(s[0]);
+  struct latency_stats_s ls;
+  s[1]->getLatencyStats(&ls);
+  test(sum(ls.fill_commands) == 0, "fill of idle stepper");
+  test(sum(ls.isr_ticks) == 0, "ISR of idle stepper");
+  printf("TEST_32 PASSED\n");
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FastAccelStepper.h"
+#include "StepperISR.h"
+#include "StepperISR_host.h"
+
+char TCCR1A;
+char TCCR1B;
+char TCCR1C;
+char TIMSK1;
+char TIFR1;
+unsigned short OCR1A;
+unsigned short OCR1B;
+
+StepperQueue fas_queue[NUM_QUEUES];
+
+void inject_fill_interrupt(int mark) {}
+void noInterrupts() {}
+void interrupts() {}
+
+// Timing of marker events with the virtual time backend. A marker is
+// reported, when it becomes the current entry of the queue. This is the
+// last step in front of the marker and before the pause of the marker.
+#define STEP_PIN 1
+#define STEP_TICKS 4000
+#define MARKER_TICKS 40000
+
+FastAccelStepperEngine engine;
+
+uint32_t steps;
+uint64_t step_tick[32];
+
+static void edge(uint64_t ticks, uint8_t pin, uint8_t level) {
+  if ((pin == STEP_PIN) && level && (steps < 32)) {
+    step_tick[steps++] = ticks;
+  }
+}
+
+void add_steps(FastAccelStepper *s, uint8_t n) {
+  struct stepper_command_s cmd = {
+      .ticks = STEP_TICKS, .steps = n, .count_up = true};
+  test(s->addQueueEntry(&cmd) == AQE_OK, "step rejected");
+}
+
+// Run tick by tick and return the tick of the marker event
+uint64_t run_till_marker(FastAccelStepper *s, uint8_t tag) {
+  uint64_t t = fas_host_ticks();
+  for (uint32_t i = 0; i < TICKS_PER_S; i++) {
+    uint8_t event = s->getMarkerEvent();
+    if (event != 0) {
+      test(event == tag, "wrong marker");
+      return t;
+    }
+    fas_host_run_until(++t);
+  }
+  test(false, "marker not reported");
+  return 0;
+}
+
+void test_timing(FastAccelStepper *s) {
+  puts("Test marker timing");
+  fas_host_init(&engine);
+  fas_host_set_edge_callback(edge);
+  steps = 0;
+  add_steps(s, 10);
+  test(s->addMarker(1, MARKER_TICKS) == AQE_OK, "marker rejected");
+  add_steps(s, 5);
+  uint64_t event = run_till_marker(s, 1);
+  printf("marker at %llu, 10th step at %llu\n", (unsigned long long)event,
+         (unsigned long long)step_tick[9]);
+  test(steps == 10, "steps in front of marker not done");
+  test(event == step_tick[9], "marker not reported with last step");
+  test(fas_host_run_until_idle(TICKS_PER_S), "queue not finished");
+  test(steps == 15, "steps after marker");
+  // the pause of the marker follows the report
+  test(step_tick[10] - event == STEP_TICKS + MARKER_TICKS,
+       "marker not reported before its pause");
+  test(s->getMarkerEvent() == 0, "marker reported twice");
+}
+
+void test_first(FastAccelStepper *s) {
+  puts("Test marker at start of queue");
+  fas_host_init(&engine);
+  fas_host_set_edge_callback(edge);
+  steps = 0;
+  uint64_t start = fas_host_ticks();
+  test(s->addMarker(2, MARKER_TICKS) == AQE_OK, "marker rejected");
+  add_steps(s, 1);
+  test(run_till_marker(s, 2) == start, "marker not reported on start");
+  test(fas_host_run_until_idle(TICKS_PER_S), "queue not finished");
+  test(steps == 1, "step after marker");
+  test(step_tick[0] - start > MARKER_TICKS, "step within marker pause");
+}
+
+int main() {
+  engine.init();
+  FastAccelStepper *s = engine.stepperConnectToPin(STEP_PIN);
+  test(s != NULL, "stepper not connected");
+  test_timing(s);
+  test_first(s);
+  printf("TEST_33 PASSED\n");
+  return 0;
+}
@@ -0,0 +1,89 @@
+#
+# Evaluate the ISR times of one benchmark run from x.vcd.
+#
+#	gawk -f bench.awk -v CASE=name -v STEPPERS=n -v SPEED=us -v ACCEL=a x.vcd
+#
+# Prints one CSV line per ISR:
+#
+#	case,steppers,speed_us,accel,isr,calls,max_cycles,mean_cycles,load_percent
+#
+# The times are measured from the high time of the StepISR (PB3) and FillISR
+# (PB4) signals as set by SIMAVR_TIME_MEASUREMENT. ISR entry and exit are not
+# included. AVR_CYCLIC_ISR enables interrupts, so the fill time is reported
+# with (AVR_CYCLIC_ISR) and without (AVR_CYCLIC_ISR_net) nested stepper ISRs.
+#
+BEGIN {
+	# vcd time units per cpu cycle at 16 MHz
+	unit = 100
+	# MIN_DELTA_TICKS of avr in cpu cycles (25 kSteps/s)
+	min_delta = 640
+	first = -1
+}
+
+/^\$var wire 1/ {
+	sym[$4] = $5
+	state[$4] = "X"
+}
+
+/^#/ {
+	time = substr($1,2) + 0
+	if (first < 0) {
+		first = time
+	}
+}
+
+/^[01].$/ {
+	s = substr($1,2)
+	level = substr($1,1,1) + 0
+	name = sym[s]
+	if ((state[s] == 0) && (level == 1)) {
+		high_since[name] = time
+		if ((name == "StepISR") && (state_of["FillISR"] == 1)) {
+			nested = 1
+		}
+		if (name == "FillISR") {
+			nested_time = 0
+		}
+	}
+	if ((state[s] == 1) && (level == 0)) {
+		dt = time - high_since[name]
+		record(name, dt)
+		if ((name == "StepISR") && nested) {
+			nested_time += dt
+			nested = 0
+		}
+		if (name == "FillISR") {
+			record("FillISR_net", dt - nested_time)
+		}
+	}
+	state[s] = level
+	state_of[name] = level
+}
+
+function record(name, dt) {
+	calls[name]++
+	sum[name] += dt
+	if (dt > max[name]) {
+		max[name] = dt
+	}
+}
+
+function report(name, isr) {
+	if (calls[name] == 0) {
+		return
+	}
+	printf("%s,%d,%d,%d,%s,%d,%d,%.1f,%.2f\n", CASE, STEPPERS, SPEED, ACCEL,
+	       isr, calls[name], max[name]/unit, sum[name]/calls[name]/unit,
+	       100*sum[name]/(time - first))
+}
+
+END {
+	report("StepISR", "AVR_STEPPER_ISR")
+	report("FillISR", "AVR_CYCLIC_ISR")
+	report("FillISR_net", "AVR_CYCLIC_ISR_net")
+	# At the maximum step rate all steppers can step at the same time
+	if (STEPPERS * max["StepISR"]/unit > min_delta) {
+		printf("%s: %d steppers * max %d cycles exceed MIN_DELTA_TICKS\n",
+		       CASE, STEPPERS, max["StepISR"]/unit) > "/dev/stderr"
+	}
+}
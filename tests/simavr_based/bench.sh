@@ -0,0 +1,96 @@
+#!/bin/sh
+#
+# ISR cycle benchmark matrix: steppers x speed x acceleration
+#
+# For each combination a directory bench_<dut>_<steppers>_v<speed>_a<accel>
+# is created with StepperDemo and SIMAVR_TIME_MEASUREMENT. The simavr trace
+# is evaluated by bench.awk and all results are collected in bench.csv.
+#
+# Use:
+#	make bench
+# or select the devices and the matrix:
+#	DUTS=atmega328p SPEEDS="40" ./bench.sh
+# Additional build flags are passed by EXTRA_FLAGS, e.g. the cost of the
+# latency histograms is the difference to the default build:
+#	EXTRA_FLAGS=-DFAS_LATENCY_STATS=0 CSV=bench_nolatency.csv ./bench.sh
+#
+# Requires platformio, gawk and run_avr as for make test.
+
+DUTS=${DUTS:-"atmega328p atmega2560_timer1"}
+SPEEDS=${SPEEDS:-"40 100 1000"}
+ACCELS=${ACCELS:-"1000 100000"}
+STEPS=${STEPS:-1000}
+CSV=${CSV:-bench.csv}
+EXTRA_FLAGS=${EXTRA_FLAGS:-""}
+
+echo "case,steppers,speed_us,accel,isr,calls,max_cycles,mean_cycles,load_percent" >$CSV
+
+for dut in $DUTS
+do
+	case $dut in
+	atmega328p)
+		BOARD=nanoatmega328
+		FLAGS=""
+		MAX_STEPPERS=2
+		;;
+	*)
+		BOARD=megaatmega2560
+		FLAGS="-DFAS_TIMER_MODULE=${dut#atmega2560_timer} "
+		MAX_STEPPERS=3
+		;;
+	esac
+	for speed in $SPEEDS
+	do
+		for accel in $ACCELS
+		do
+			n=1
+			while [ $n -le $MAX_STEPPERS ]
+			do
+				# start all steppers and wait for each one
+				INPUT=""
+				i=1
+				while [ $i -le $n ]
+				do
+					INPUT="$INPUT M$i A$accel V$speed R$STEPS"
+					i=`expr $i + 1`
+				done
+				i=1
+				while [ $i -le $n ]
+				do
+					INPUT="$INPUT M$i W"
+					i=`expr $i + 1`
+				done
+
+				CASE=bench_${dut}_${n}_v${speed}_a${accel}
+				mkdir -p $CASE/src
+				(cd $CASE/src; ln -sf ../../../../examples/StepperDemo/* .)
+				cat >$CASE/platformio.ini <<EOF
+; generated by bench.sh
+[platformio]
+
+[common]
+build_flags = -D SIM_TEST_INPUT='"$INPUT "' -D SIMAVR_TIME_MEASUREMENT
+
+[env:$dut]
+platform    = atmelavr
+board       = $BOARD
+framework   = arduino
+build_flags = -Werror -Wall $FLAGS$EXTRA_FLAGS \${common.build_flags}
+lib_extra_dirs = ../../../..
+EOF
+				rm -f $CASE/x.vcd
+				make -C $CASE -f ../Makefile.test x.vcd >$CASE/build.log 2>&1
+				if [ $? -ne 0 ]
+				then
+					echo "FAIL $CASE, see $CASE/build.log"
+					exit 1
+				fi
+				gawk -f bench.awk -v CASE=$CASE -v STEPPERS=$n \
+					-v SPEED=$speed -v ACCEL=$accel $CASE/x.vcd >>$CSV
+				n=`expr $n + 1`
+			done
+		done
+	done
+done
+
+cat $CSV
@@ -1,5 +1,9 @@
 BEGIN {
+	# vcd time units per us. Host traces of tests/pc_based use -v REF=1000000
 	ref = 16*100
+	if (REF) {
+		ref = REF
+	}
 	dump_all = 0
 }
 
@@ -42,6 +46,9 @@ dump_all == 1{print}
 
 		if (sym[s] ~ /Step/) {
 			channel = substr(sym[s],5)
+			if (!(channel in first_step)) {
+				first_step[channel] = time
+			}
 			if(!SILENCE) printf("%s: ", channel)
 			dir = "Dir" channel
 			if (dir in to_sym) {
@@ -124,5 +131,16 @@ END {
 			print(info) >"result.txt"
 		}
 	}
+
+	# Tests of synchronized start check the time of the first steps
+	if (DIR ~ /sync/) {
+		for (ch in channels) {
+			if ((ch != "A") && (ch in first_step) && ("A" in first_step)) {
+				info = sprintf("First step %s-A=%d\n",ch,first_step[ch]-first_step["A"])
+				if(!SILENCE) print(info)
+				print(info) >"result.txt"
+			}
+		}
+	}
 }
 